@@ -2,273 +2,1291 @@
 #include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
+#include <time.h>
+#include <pthread.h>
+#include <dirent.h>
 
-// Define the size of the EEPROM (change this to match your EEPROM size)
-#define EEPROM_SIZE 1024
+#include "eeprom_archive.h"
+#include "eeprom_catalog.h"
+#include "eeprom_diff.h"
+#include "eeprom_hexdump.h"
+#include "eeprom_layout.h"
+#include "eeprom_log.h"
+#include "eeprom_metrics.h"
+#include "eeprom_store.h"
 
-// Define your data types here
-typedef char RJS8T;
-typedef unsigned char RJU8T;
-typedef signed short RJS16T;
-typedef unsigned short RJU16T;
-typedef signed int RJS32T;
-typedef unsigned int RJU32T;
-
-// Define lengths and offsets for your parameters
-#define SERIAL_NUMBER_LENGTH 18
-#define PCB_SERIAL_NUMBER_LENGTH 18
-#define PRODUCT_ID_LENGTH 12
-#define MAC_ID_LENGTH 6
-#define MAC_ID_COUNT 3
-
-// Define fixed offsets for each parameter
-#define SERIAL_NUMBER_OFFSET 0
-#define PCB_SERIAL_NUMBER_OFFSET (SERIAL_NUMBER_OFFSET + SERIAL_NUMBER_LENGTH)
-#define PRODUCT_ID_OFFSET (PCB_SERIAL_NUMBER_OFFSET + PCB_SERIAL_NUMBER_LENGTH)
-#define MAC_ID_OFFSET (PRODUCT_ID_OFFSET + PRODUCT_ID_LENGTH)
+// Default size of the EEPROM image (override with --size)
+#define EEPROM_SIZE 1024
 
 // File path for simulating EEPROM data
 #define EEPROM_FILE_PATH "eeprom_data.bin"
 
-// Function to print a hex dump of EEPROM data with addresses and characters
-void printHexDump(const char *data, int length) {
-    printf("EEPROM Hex Dump:\n");
-
-    for (int i = 0; i < length; i++) {
-        if (i % 16 == 0) {
-            if (i > 0) {
-                printf("  ");
-                for (int j = i - 16; j < i; j++) {
-                    if (j >= 0) {
-                        char c = data[j];
-                        if (c >= 32 && c <= 126) {
-                            putchar(c);
-                        } else {
-                            putchar('.');
-                        }
-                    }
+// Function to apply a field change (or clear it when data is NULL) and
+// patch the parameter block checksum to match, without rehashing the block
+size_t applyField(EepromStore *store, const EepromLayout *layout, uint32_t *checksum,
+                  unsigned int offset, const char *data, unsigned int length) {
+    char previous[EEPROM_LAYOUT_LIMIT];
+
+    memcpy(previous, store->data + offset, length);
+    size_t changed = data ? eepromStoreUpdate(store, offset, data, length) : eepromStoreFill(store, offset, 0, length);
+    if (changed) {
+        *checksum = eepromChecksumPatch(layout, *checksum, offset, previous, store->data + offset, length);
+    }
+    return changed;
+}
+
+// Function to write a log record into the mapped image
+static int storeLogWrite(void *context, unsigned int offset, const char *record, unsigned int length) {
+    eepromStoreUpdate((EepromStore *)context, offset, record, length);
+    return 0;
+}
+
+// Monotonic time in seconds
+static double monotonicSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Bulk mode: build one image per record of a CSV or JSONL stream.
+//
+// The main thread reads the input line by line into a bounded queue, so
+// memory stays flat however long the stream is. A pool of workers takes
+// records from the queue and builds each image in its own preallocated
+// buffer. Images go to <dir>/<serial>.bin, or into a packed file where
+// record n sits at n * image size so workers write without ordering.
+
+#define BULK_QUEUE_LENGTH 256
+#define BULK_LINE_MAX 1024
+
+// MAC IDs a worker reserves from the pool at a time
+#define BULK_MAC_RESERVE 4096
+
+// Input formats, chosen from the first record
+#define BULK_CSV 0
+#define BULK_JSONL 1
+
+typedef struct {
+    char line[BULK_LINE_MAX];
+    unsigned long lineNumber;
+    unsigned long index; // Position of the record in the packed file
+} BulkRecord;
+
+typedef struct {
+    const EepromLayout *layout;
+    size_t imageSize;
+    const char *outDir;
+    int packFd;
+    int format;
+    int columns[FIELD_COUNT]; // CSV column order as field ids
+    int columnCount;
+
+    BulkRecord queue[BULK_QUEUE_LENGTH];
+    int head;
+    int count;
+    int done;
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+
+    unsigned long written;
+    unsigned long rejected;
+} BulkJob;
+
+// Function to strip surrounding blanks and quotes from a CSV value in place
+static char *bulkTrim(char *value) {
+    size_t length;
+
+    while (*value == ' ' || *value == '\t') {
+        value++;
+    }
+    length = strlen(value);
+    while (length > 0 && strchr(" \t\r\n", value[length - 1])) {
+        value[--length] = '\0';
+    }
+    if (length >= 2 && value[0] == '"' && value[length - 1] == '"') {
+        value[length - 1] = '\0';
+        value++;
+    }
+    return value;
+}
+
+// Function to find the next "key": value pair of a flat JSON object.
+// Returns a pointer past the pair, or NULL at the end of the object.
+static char *bulkJsonPair(char *cursor, char **key, char **value) {
+    cursor = strchr(cursor, '"');
+    if (!cursor) {
+        return NULL;
+    }
+    *key = ++cursor;
+    cursor = strchr(cursor, '"');
+    if (!cursor) {
+        return NULL;
+    }
+    *cursor++ = '\0';
+    cursor += strspn(cursor, " \t:");
+
+    if (*cursor == '"') {
+        // String value, unescaping \" and \\ in place
+        char *out = *value = ++cursor;
+        while (*cursor && *cursor != '"') {
+            if (*cursor == '\\' && cursor[1]) {
+                cursor++;
+            }
+            *out++ = *cursor++;
+        }
+        if (*cursor) {
+            cursor++;
+        }
+        *out = '\0';
+        return cursor;
+    }
+
+    // Number or literal up to the next separator
+    *value = cursor;
+    cursor += strcspn(cursor, ",} \t\r\n");
+    if (*cursor) {
+        *cursor++ = '\0';
+    }
+    return cursor;
+}
+
+// Function to build one image from a record.
+// Returns 0, or -1 after printing why the record was rejected.
+static int bulkBuildImage(BulkJob *job, char *line, unsigned long lineNumber, char *image, char *serial) {
+    const EepromLayout *layout = job->layout;
+    int column = 0;
+    char *cursor = line, *key, *value;
+
+    memset(image, 0, job->imageSize);
+    serial[0] = '\0';
+    for (;;) {
+        int field;
+        if (job->format == BULK_JSONL) {
+            cursor = bulkJsonPair(cursor, &key, &value);
+            if (!cursor) {
+                break;
+            }
+            field = eepromFieldForKey(key);
+            if (field < 0) {
+                fprintf(stderr, "Line %lu: unknown parameter %s\n", lineNumber, key);
+                return -1;
+            }
+        } else {
+            if (!cursor) {
+                break;
+            }
+            value = cursor;
+            cursor = strchr(cursor, ',');
+            if (cursor) {
+                *cursor++ = '\0';
+            }
+            value = bulkTrim(value);
+            if (column == job->columnCount) {
+                fprintf(stderr, "Line %lu: too many columns\n", lineNumber);
+                return -1;
+            }
+            field = job->columns[column++];
+        }
+
+        if (*value == '\0') {
+            continue;
+        }
+        if (eepromFieldEncode(field, value, image + layout->offset[field]) < 0) {
+            fprintf(stderr, "Line %lu: invalid %s\n", lineNumber, eepromFields[field].key);
+            return -1;
+        }
+        if (field == FIELD_SERIAL_NUMBER) {
+            snprintf(serial, FIELD_LENGTH_SERIAL_NUMBER + 1, "%s", value);
+        }
+    }
+
+    char checksum[FIELD_LENGTH_CHECKSUM];
+    eepromPutU32(checksum, eepromChecksumCompute(layout, image));
+    memcpy(image + layout->offset[FIELD_CHECKSUM], checksum, FIELD_LENGTH_CHECKSUM);
+    return 0;
+}
+
+// Function to store a built image in the output directory or packed file
+static int bulkWriteImage(BulkJob *job, const char *image, const char *serial, unsigned long lineNumber,
+                          unsigned long index) {
+    if (job->packFd >= 0) {
+        off_t offset = (off_t)index * job->imageSize;
+        size_t done = 0;
+        while (done < job->imageSize) {
+            ssize_t put = pwrite(job->packFd, image + done, job->imageSize - done, offset + done);
+            if (put < 0) {
+                perror("Failed to write packed image");
+                return -1;
+            }
+            done += put;
+        }
+        return 0;
+    }
+
+    // Images are named by serial number, characters unsafe in a file name become '_'
+    char path[PATH_MAX];
+    char name[FIELD_LENGTH_SERIAL_NUMBER + 1];
+    if (serial[0]) {
+        for (int i = 0; i <= FIELD_LENGTH_SERIAL_NUMBER; i++) {
+            name[i] = (serial[i] == '/' || serial[i] == ' ' || serial[i] == '\\') ? '_' : serial[i];
+        }
+        snprintf(path, sizeof(path), "%s/%s.bin", job->outDir, name);
+    } else {
+        snprintf(path, sizeof(path), "%s/record-%08lu.bin", job->outDir, index);
+    }
+
+    // An existing image is never replaced, so a repeated serial is rejected
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 && errno == EEXIST) {
+        fprintf(stderr, "Line %lu: %s already exists\n", lineNumber, path);
+        return -1;
+    }
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    int ok = write(fd, image, job->imageSize) == (ssize_t)job->imageSize;
+    if (close(fd) != 0 || !ok) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+// Function run by every worker of the pool
+static void *bulkWorker(void *arg) {
+    BulkJob *job = arg;
+    BulkRecord record;
+    char serial[FIELD_LENGTH_SERIAL_NUMBER + 1];
+    char *image = malloc(job->imageSize);
+    unsigned long written = 0, rejected = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        while (job->count == 0 && !job->done) {
+            pthread_cond_wait(&job->notEmpty, &job->lock);
+        }
+        if (job->count == 0) {
+            pthread_mutex_unlock(&job->lock);
+            break;
+        }
+        record = job->queue[job->head];
+        job->head = (job->head + 1) % BULK_QUEUE_LENGTH;
+        job->count--;
+        pthread_cond_signal(&job->notFull);
+        pthread_mutex_unlock(&job->lock);
+
+        if (image && bulkBuildImage(job, record.line, record.lineNumber, image, serial) == 0 &&
+            bulkWriteImage(job, image, serial, record.lineNumber, record.index) == 0) {
+            written++;
+        } else {
+            rejected++;
+        }
+    }
+
+    pthread_mutex_lock(&job->lock);
+    job->written += written;
+    job->rejected += rejected;
+    pthread_mutex_unlock(&job->lock);
+    if (eepromMacPool) {
+        macPoolRelease(eepromMacPool);
+    }
+    free(image);
+    return NULL;
+}
+
+// Function to read the CSV column order from a header line of field keys.
+// Returns 1 if the line was a header, 0 if it is data.
+static int bulkParseHeader(BulkJob *job, const char *line) {
+    char copy[BULK_LINE_MAX];
+    char *save;
+    int count = 0;
+
+    snprintf(copy, sizeof(copy), "%s", line);
+    for (char *name = strtok_r(copy, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+        int field = eepromFieldForKey(bulkTrim(name));
+        if (field < 0 || count == FIELD_COUNT) {
+            return 0;
+        }
+        job->columns[count++] = field;
+    }
+    job->columnCount = count;
+    return count > 0;
+}
+
+// Function to generate images for every record of the input and report the rate.
+// Returns 0 when every record produced an image.
+int runBulk(const char *inputPath, const char *outDir, const char *packPath, const EepromLayout *layout,
+            size_t imageSize, int workers) {
+    static BulkJob job;
+    FILE *input = strcmp(inputPath, "-") == 0 ? stdin : fopen(inputPath, "r");
+
+    if (!input) {
+        perror("Failed to open bulk input");
+        return 1;
+    }
+    memset(&job, 0, sizeof(job));
+    job.layout = layout;
+    job.imageSize = imageSize;
+    job.outDir = outDir;
+    job.packFd = -1;
+    if (packPath) {
+        job.packFd = open(packPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (job.packFd < 0) {
+            perror("Failed to create packed file");
+            return 1;
+        }
+    }
+
+    // Default CSV columns: serial, board serial, product ID, MAC
+    static const int defaultColumns[] = {FIELD_SERIAL_NUMBER, FIELD_PCB_SERIAL_NUMBER, FIELD_PRODUCT_ID, FIELD_MAC_ID};
+    memcpy(job.columns, defaultColumns, sizeof(defaultColumns));
+    job.columnCount = sizeof(defaultColumns) / sizeof(defaultColumns[0]);
+
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.notEmpty, NULL);
+    pthread_cond_init(&job.notFull, NULL);
+    eepromFieldMessages = 0;
+    crc32cInit();
+    // Workers take MAC IDs in large reservations instead of one sync per record
+    if (eepromMacPool) {
+        eepromMacPool->reserve = BULK_MAC_RESERVE;
+    }
+
+    pthread_t *threads = calloc(workers, sizeof(pthread_t));
+    int started = 0;
+    double start = monotonicSeconds();
+    while (threads && started < workers && pthread_create(&threads[started], NULL, bulkWorker, &job) == 0) {
+        started++;
+    }
+    if (started == 0) {
+        perror("Failed to start bulk workers");
+        free(threads);
+        return 1;
+    }
+
+    char line[BULK_LINE_MAX];
+    unsigned long lineNumber = 0, records = 0;
+    int first = 1;
+    while (fgets(line, sizeof(line), input)) {
+        lineNumber++;
+        // A line that does not fit is rejected whole, its rest is skipped
+        if (!strchr(line, '\n') && !feof(input)) {
+            while (fgets(line, sizeof(line), input) && !strchr(line, '\n')) {
+            }
+            fprintf(stderr, "Line %lu: longer than %d bytes\n", lineNumber, BULK_LINE_MAX - 2);
+            pthread_mutex_lock(&job.lock);
+            job.rejected++;
+            pthread_mutex_unlock(&job.lock);
+            records++;
+            continue;
+        }
+        char *text = line + strspn(line, " \t");
+        if (*text == '\0' || *text == '\n' || *text == '\r' || *text == '#') {
+            continue;
+        }
+        if (first) {
+            first = 0;
+            job.format = *text == '{' ? BULK_JSONL : BULK_CSV;
+            if (job.format == BULK_CSV && bulkParseHeader(&job, text)) {
+                continue;
+            }
+        }
+
+        pthread_mutex_lock(&job.lock);
+        while (job.count == BULK_QUEUE_LENGTH) {
+            pthread_cond_wait(&job.notFull, &job.lock);
+        }
+        BulkRecord *record = &job.queue[(job.head + job.count) % BULK_QUEUE_LENGTH];
+        memcpy(record->line, text, strlen(text) + 1);
+        record->lineNumber = lineNumber;
+        record->index = records++;
+        job.count++;
+        pthread_cond_signal(&job.notEmpty);
+        pthread_mutex_unlock(&job.lock);
+    }
+
+    pthread_mutex_lock(&job.lock);
+    job.done = 1;
+    pthread_cond_broadcast(&job.notEmpty);
+    pthread_mutex_unlock(&job.lock);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double seconds = monotonicSeconds() - start;
+    free(threads);
+    if (input != stdin) {
+        fclose(input);
+    }
+
+    int status = job.rejected > 0 ? 1 : 0;
+    if (job.packFd >= 0) {
+        // Rejected records leave a zero image in their slot
+        if (ftruncate(job.packFd, (off_t)records * imageSize) != 0 || close(job.packFd) != 0) {
+            perror("Failed to finish packed file");
+            status = 1;
+        }
+    }
+    printf("Bulk: %lu images written, %lu rejected, %d workers, %.2f s, %.0f images/sec\n", job.written,
+           job.rejected, started, seconds, seconds > 0 ? job.written / seconds : 0.0);
+    return status;
+}
+
+// Compare and audit: diff an image, or every image of a directory, against
+// a golden template. Images are mapped read-only, compared with the
+// word-wide kernel of eeprom_diff.h and reported per field.
+
+// Audit results per image
+#define AUDIT_SAME 0
+#define AUDIT_DIFFERENT 1
+#define AUDIT_UNREADABLE 2
+
+typedef struct {
+    char *name;
+    int status;
+    int checksumBad;
+    unsigned int fieldMask;
+    size_t otherBytes;
+    size_t size;
+} AuditEntry;
+
+typedef struct {
+    const EepromLayout *layout;
+    int dirFd;
+    const Archive *archive; // Members are audited instead of the files of dirFd
+    const char *golden;
+    size_t goldenSize;
+    AuditEntry *entries;
+    size_t count;
+    size_t next; // Next entry to take, shared by the workers
+} AuditJob;
+
+// Function to map an image read-only. Returns NULL on error; an empty file
+// maps to an empty image.
+static const char *mapImage(int dirFd, const char *path, size_t *size) {
+    struct stat info;
+    int fd = openat(dirFd, path, O_RDONLY);
+
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        return NULL;
+    }
+    *size = info.st_size;
+    if (*size == 0) {
+        close(fd);
+        return "";
+    }
+    void *data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    return data == MAP_FAILED ? NULL : data;
+}
+
+static void unmapImage(const char *data, size_t size) {
+    if (size > 0) {
+        munmap((void *)data, size);
+    }
+}
+
+// Function to check an image's parameter block checksum, when it is large enough to hold one
+static int imageChecksumBad(const EepromLayout *layout, const char *data, size_t size) {
+    uint32_t computed;
+    return size >= layout->end && eepromChecksumVerify(layout, data, &computed) == CHECKSUM_BAD;
+}
+
+// Function to compare two images and print the differences per field.
+// Returns 0 when they are identical, 2 when they differ.
+int runCompare(const char *goldenPath, const char *imagePath, const EepromLayout *layout) {
+    size_t goldenSize, imageSize;
+    const char *golden = mapImage(AT_FDCWD, goldenPath, &goldenSize);
+    const char *image = golden ? mapImage(AT_FDCWD, imagePath, &imageSize) : NULL;
+    static DiffResult result;
+    char value[EEPROM_LAYOUT_LIMIT * 4 + 1];
+
+    if (!golden || !image) {
+        perror(golden ? imagePath : goldenPath);
+        if (golden) {
+            unmapImage(golden, goldenSize);
+        }
+        return 1;
+    }
+
+    crc32cInit();
+    eepromDiff(layout, image, imageSize, golden, goldenSize, &result);
+    if (result.bytes == 0) {
+        printf("%s is identical to %s.\n", imagePath, goldenPath);
+    } else {
+        printf("%s differs from %s in %zu bytes:\n", imagePath, goldenPath, result.bytes);
+        for (int id = 0; id < FIELD_COUNT; id++) {
+            unsigned int end = layout->offset[id] + eepromFields[id].length;
+            if (!(result.fieldMask & (1u << id))) {
+                continue;
+            }
+            printf("%-8s %4zu bytes", eepromFields[id].key, result.fieldBytes[id]);
+            if (end <= goldenSize) {
+                eepromDiffFormat(id, golden + layout->offset[id], value, sizeof(value));
+                printf("  golden %s", value);
+            }
+            if (end <= imageSize) {
+                eepromDiffFormat(id, image + layout->offset[id], value, sizeof(value));
+                printf("  image %s", value);
+            }
+            printf("\n");
+        }
+        if (result.otherBytes > 0) {
+            printf("%-8s %4zu bytes ", "other", result.otherBytes);
+            for (int i = 0; i < result.otherCount; i++) {
+                printf(" 0x%04zX-0x%04zX", result.other[i].begin, result.other[i].end - 1);
+            }
+            printf(result.truncated ? " ...\n" : "\n");
+        }
+        if (imageSize != goldenSize) {
+            printf("size     %zu bytes, golden %zu bytes\n", imageSize, goldenSize);
+        }
+    }
+    if (imageChecksumBad(layout, image, imageSize)) {
+        printf("Checksum mismatch in %s.\n", imagePath);
+    }
+
+    unmapImage(image, imageSize);
+    unmapImage(golden, goldenSize);
+    return result.bytes > 0 ? 2 : 0;
+}
+
+// Function run by every audit worker: take the next image and diff it.
+// Archive members are decoded into the worker's own buffer.
+static void *auditWorker(void *arg) {
+    AuditJob *job = arg;
+    DiffResult result;
+    char *member = job->archive ? malloc(job->archive->header->imageSize) : NULL;
+
+    for (;;) {
+        size_t index = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (index >= job->count) {
+            break;
+        }
+        AuditEntry *entry = &job->entries[index];
+        const char *image;
+        if (job->archive) {
+            entry->size = job->archive->header->imageSize;
+            image = member && archiveExtract(job->archive, index, member) == 0 ? member : NULL;
+        } else {
+            image = mapImage(job->dirFd, entry->name, &entry->size);
+        }
+        if (!image) {
+            entry->status = AUDIT_UNREADABLE;
+            continue;
+        }
+        eepromDiff(job->layout, image, entry->size, job->golden, job->goldenSize, &result);
+        entry->status = result.bytes > 0 ? AUDIT_DIFFERENT : AUDIT_SAME;
+        entry->fieldMask = result.fieldMask;
+        entry->otherBytes = result.otherBytes;
+        entry->checksumBad = imageChecksumBad(job->layout, image, entry->size);
+        if (!job->archive) {
+            unmapImage(image, entry->size);
+        }
+    }
+    free(member);
+    return NULL;
+}
+
+static int compareAuditEntries(const void *a, const void *b) {
+    return strcmp(((const AuditEntry *)a)->name, ((const AuditEntry *)b)->name);
+}
+
+// Function to diff every image of a directory, or every member of an
+// archive, against a golden template. Prints one line per image that
+// differs, then the number of images each field differs in. Returns 0 when
+// all images match, 2 when any differs.
+int runAudit(const char *goldenPath, const char *dirPath, const EepromLayout *layout, int workers) {
+    static AuditJob job;
+    static Archive archive;
+    size_t capacity = 1024;
+    struct dirent *dirEntry;
+    DIR *dir = NULL;
+
+    memset(&job, 0, sizeof(job));
+    job.layout = layout;
+    job.golden = mapImage(AT_FDCWD, goldenPath, &job.goldenSize);
+    if (!job.golden) {
+        perror(goldenPath);
+        return 1;
+    }
+    if (archiveOpen(&archive, dirPath) == 0) {
+        // The table is in name order already
+        job.archive = &archive;
+        capacity = archive.header->imageCount + 1;
+        job.entries = malloc(capacity * sizeof(AuditEntry));
+        for (size_t i = 0; job.entries && i < archive.header->imageCount; i++) {
+            job.entries[job.count++] = (AuditEntry){strdup(archiveName(&archive, i)), AUDIT_SAME, 0, 0, 0, 0};
+        }
+    } else if ((dir = opendir(dirPath)) != NULL) {
+        job.dirFd = dirfd(dir);
+        job.entries = malloc(capacity * sizeof(AuditEntry));
+    } else {
+        perror(dirPath);
+        unmapImage(job.golden, job.goldenSize);
+        return 1;
+    }
+    while (dir && job.entries && (dirEntry = readdir(dir)) != NULL) {
+        if (dirEntry->d_name[0] == '.' || (dirEntry->d_type != DT_REG && dirEntry->d_type != DT_UNKNOWN)) {
+            continue;
+        }
+        if (job.count == capacity) {
+            AuditEntry *grown = realloc(job.entries, capacity * 2 * sizeof(AuditEntry));
+            if (!grown) {
+                break;
+            }
+            job.entries = grown;
+            capacity *= 2;
+        }
+        job.entries[job.count] = (AuditEntry){strdup(dirEntry->d_name), AUDIT_SAME, 0, 0, 0, 0};
+        job.count++;
+    }
+    if (!job.entries) {
+        perror("Failed to list images");
+        if (dir) {
+            closedir(dir);
+        }
+        archiveClose(&archive);
+        unmapImage(job.golden, job.goldenSize);
+        return 1;
+    }
+    if (dir) {
+        qsort(job.entries, job.count, sizeof(AuditEntry), compareAuditEntries);
+    }
+
+    crc32cInit();
+    pthread_t *threads = calloc(workers, sizeof(pthread_t));
+    int started = 0;
+    double start = monotonicSeconds();
+    while (threads && started < workers && pthread_create(&threads[started], NULL, auditWorker, &job) == 0) {
+        started++;
+    }
+    if (started == 0) {
+        auditWorker(&job);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double seconds = monotonicSeconds() - start;
+    free(threads);
+
+    // One line per image that differs, in name order
+    unsigned long fieldImages[FIELD_COUNT] = {0};
+    unsigned long otherImages = 0, sizeImages = 0, checksumImages = 0;
+    unsigned long same = 0, different = 0, unreadable = 0;
+    for (size_t i = 0; i < job.count; i++) {
+        AuditEntry *entry = &job.entries[i];
+        if (entry->status == AUDIT_UNREADABLE) {
+            printf("%s: unreadable\n", entry->name);
+            unreadable++;
+        } else if (entry->status == AUDIT_DIFFERENT || entry->checksumBad) {
+            printf("%s:", entry->name);
+            for (int id = 0; id < FIELD_COUNT; id++) {
+                if (entry->fieldMask & (1u << id)) {
+                    printf(" %s", eepromFields[id].key);
+                    fieldImages[id]++;
                 }
-                printf("\n");
             }
-            printf("0x%04X: ", i);
+            if (entry->otherBytes > 0) {
+                printf(" other(%zu)", entry->otherBytes);
+                otherImages++;
+            }
+            if (entry->size != job.goldenSize) {
+                printf(" size(%zu)", entry->size);
+                sizeImages++;
+            }
+            if (entry->checksumBad) {
+                printf(" [checksum mismatch]");
+                checksumImages++;
+            }
+            printf("\n");
+        }
+        if (entry->status == AUDIT_SAME) {
+            same++;
+        } else if (entry->status == AUDIT_DIFFERENT) {
+            different++;
+        }
+        free(entry->name);
+    }
+
+    printf("Audit: %zu images, %lu identical, %lu differ, %lu unreadable, %d workers, %.2f s, %.0f images/sec\n",
+           job.count, same, different, unreadable, started, seconds, seconds > 0 ? job.count / seconds : 0.0);
+    for (int id = 0; id < FIELD_COUNT; id++) {
+        if (fieldImages[id] > 0) {
+            printf("  %-8s %lu images\n", eepromFields[id].key, fieldImages[id]);
+        }
+    }
+    if (otherImages > 0) {
+        printf("  %-8s %lu images\n", "other", otherImages);
+    }
+    if (sizeImages > 0) {
+        printf("  %-8s %lu images\n", "size", sizeImages);
+    }
+    if (checksumImages > 0) {
+        printf("  %lu images with a checksum mismatch\n", checksumImages);
+    }
+
+    free(job.entries);
+    if (dir) {
+        closedir(dir);
+    }
+    archiveClose(&archive);
+    unmapImage(job.golden, job.goldenSize);
+    if (unreadable > 0) {
+        return 1;
+    }
+    return different > 0 || checksumImages > 0 ? 2 : 0;
+}
+
+// Function to run the catalog options: update the catalog from a
+// directory, then answer lookups and the duplicate check from the mapped
+// catalog. Returns 0 on success, 1 when a lookup found nothing or failed,
+// 2 when duplicates were found.
+int runCatalog(const char *catalogPath, const char *indexDir, const char **lookups, int lookupCount,
+               int duplicates, const EepromLayout *layout) {
+    Catalog catalog;
+    int status = 0;
+
+    if (indexDir && catalogUpdate(catalogPath, indexDir, layout) != 0) {
+        return 1;
+    }
+    if (lookupCount == 0 && !duplicates) {
+        return 0;
+    }
+    if (catalogOpen(&catalog, catalogPath) != 0) {
+        printf("Cannot open catalog %s. Build it with --index <dir>.\n", catalogPath);
+        return 1;
+    }
+
+    for (int i = 0; i < lookupCount; i++) {
+        unsigned char key[CATALOG_KEY_LENGTH];
+        char name[16];
+        const char *value = strchr(lookups[i], '=');
+        int kind = -1, length = -1;
+
+        snprintf(name, sizeof(name), "%.*s", value ? (int)(value - lookups[i]) : 0, lookups[i]);
+        int field = value ? eepromFieldForKey(name) : -1;
+        for (int k = 0; k < CATALOG_KIND_COUNT; k++) {
+            if (catalogFields[k] == field) {
+                kind = k;
+            }
+        }
+        if (kind >= 0) {
+            length = catalogKey(kind, value + 1, key);
+        }
+        if (length < 0) {
+            printf("Invalid argument for --lookup. Use SRNUM, BSRNUM, PID or MACID=<value>.\n");
+            status = 1;
+        } else if (catalogLookup(&catalog, kind, key, length) == 0) {
+            printf("No image with %s.\n", lookups[i]);
+            status = 1;
+        }
+    }
+    if (duplicates) {
+        unsigned long found = catalogDuplicates(&catalog);
+        printf("Duplicates: %lu keys held by more than one image.\n", found);
+        if (found > 0 && status == 0) {
+            status = 2;
+        }
+    }
+    catalogClose(&catalog);
+    return status;
+}
+
+// Function to write an extracted member to <dir>/<name>
+static int writeMember(const char *outDir, const char *name, const char *image, size_t size) {
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/%s", outDir, name);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(path);
+        return 1;
+    }
+    int ok = write(fd, image, size) == (ssize_t)size;
+    if (close(fd) != 0 || !ok) {
+        perror(path);
+        return 1;
+    }
+    return 0;
+}
+
+// Function to run the archive options: create the archive on the first
+// append, append images, then extract one member (to a file, or as a hex
+// dump) or stream every member to stdout. With no action, prints a summary.
+// Returns 0 on success, 1 on errors or when the member is missing.
+int runArchive(const char *archivePath, const char **appends, int appendCount, const char *templatePath,
+               long imageSize, const char *extractName, const char *outDir, int stream,
+               const HexDumpOptions *dumpOptions) {
+    Archive archive;
+    int status = 0;
+
+    if (appendCount > 0 && access(archivePath, F_OK) != 0) {
+        // Sparse records against zeros, or deltas against a golden template
+        size_t templateSize = imageSize;
+        const char *base = templatePath ? mapImage(AT_FDCWD, templatePath, &templateSize) : calloc(1, imageSize);
+        if (!base || templateSize == 0) {
+            perror(templatePath ? templatePath : "Failed to create archive");
+            return 1;
+        }
+        status = archiveCreate(archivePath, base, templateSize) == 0 ? 0 : 1;
+        if (templatePath) {
+            unmapImage(base, templateSize);
+        } else {
+            free((void *)base);
+        }
+    }
+    if (status == 0 && appendCount > 0 && archiveAppend(archivePath, appends, appendCount) != 0) {
+        status = 1;
+    }
+    if (status != 0 || (appendCount > 0 && !extractName && !stream)) {
+        return status;
+    }
+
+    if (archiveOpen(&archive, archivePath) != 0) {
+        printf("Cannot open archive %s. Create it with --append <image or dir>.\n", archivePath);
+        return 1;
+    }
+    size_t size = archive.header->imageSize;
+    uint64_t count = archive.header->imageCount;
+    char *image = malloc(size);
+
+    if (!image) {
+        perror("Failed to read archive");
+        status = 1;
+    } else if (extractName) {
+        long index = archiveFind(&archive, extractName);
+        if (index < 0) {
+            printf("No member %s in %s.\n", extractName, archivePath);
+            status = 1;
+        } else if (archiveExtract(&archive, index, image) != 0) {
+            fprintf(stderr, "Damaged record for %s\n", extractName);
+            status = 1;
+        } else if (outDir) {
+            status = writeMember(outDir, extractName, image, size);
+        } else {
+            uint64_t metricStart = eepromMetricStart();
+            hexDumpToStream(stdout, image, size, dumpOptions);
+            eepromMetricRecord(METRIC_DUMP, metricStart, size, 1, 0, 0);
+        }
+    } else if (stream) {
+        // Members back to back in name order, the layout of a --pack file
+        for (uint64_t i = 0; i < count && status == 0; i++) {
+            if (archiveExtract(&archive, i, image) != 0) {
+                fprintf(stderr, "Damaged record for %s\n", archiveName(&archive, i));
+                status = 1;
+            } else if (fwrite(image, 1, size, stdout) != size) {
+                perror("Failed to stream archive");
+                status = 1;
+            }
         }
-        printf("%02X ", (unsigned char)data[i]);
+        if (fflush(stdout) != 0) {
+            status = 1;
+        }
+    } else {
+        uint64_t records = archive.header->end - archive.header->templateOffset - size;
+        printf("Archive %s: %llu images of %zu bytes, %s template, %zu bytes, %.1f bytes per image\n", archivePath,
+               (unsigned long long)count, size, catalogBlank(archive.base, size) ? "blank" : "golden", archive.length,
+               count ? (double)records / count : 0.0);
     }
 
-    printf("\n");
+    free(image);
+    archiveClose(&archive);
+    return status;
 }
 
+// Options handled by this tool in addition to the generated field options
+static const struct option toolOptions[] = {
+    {"noDump", no_argument, 0, 'q'},
+    {"file", required_argument, 0, 'f'},
+    {"size", required_argument, 0, 'z'},
+    {"atomic", no_argument, 0, 'a'},
+    {"range", required_argument, 0, 'R'},
+    {"width", required_argument, 0, 'w'},
+    {"squeeze", no_argument, 0, 'S'},
+    {"machine", no_argument, 0, 'M'},
+    {"layout", required_argument, 0, 'L'},
+    {"verify", no_argument, 0, 'V'},
+    {"bulk", required_argument, 0, 'B'},
+    {"out", required_argument, 0, 'o'},
+    {"pack", required_argument, 0, 'k'},
+    {"jobs", required_argument, 0, 'j'},
+    {"macPool", required_argument, 0, 'P'},
+    {"macPoolInit", required_argument, 0, 'I'},
+    {"logSet", required_argument, 0, 'U'},
+    {"logGet", required_argument, 0, 'G'},
+    {"logList", no_argument, 0, 'T'},
+    {"metrics", required_argument, 0, 'X'},
+    {"compare", required_argument, 0, 'C'},
+    {"audit", required_argument, 0, 'A'},
+    {"catalog", required_argument, 0, 'Q'},
+    {"index", required_argument, 0, 'N'},
+    {"lookup", required_argument, 0, 'O'},
+    {"duplicates", no_argument, 0, 'D'},
+    {"archive", required_argument, 0, 'Y'},
+    {"append", required_argument, 0, 'H'},
+    {"template", required_argument, 0, 'J'},
+    {"extract", required_argument, 0, 'E'},
+    {"stream", no_argument, 0, 'W'},
+    {0, 0, 0, 0}
+};
+static const char toolShortOptions[] = "qf:z:aR:w:SML:VB:o:k:j:P:I:U:G:TX:C:A:Q:N:O:DY:H:J:E:W";
+
 int main(int argc, char *argv[]) {
     int option;
-    const struct option long_options[] = {
-        {"updSRNUM", required_argument, 0, 's'},
-        {"updBSRNUM", required_argument, 0, 'b'},
-        {"updPID", required_argument, 0, 'p'},
-        {"updMACID", required_argument, 0, 'm'},
-        {"clearSRNUM", no_argument, 0, 'c'},
-        {"clearBSRNUM", no_argument, 0, 'd'},
-        {"clearPID", no_argument, 0, 'e'},
-        {"clearMACID", no_argument, 0, 'n'},
-        {"updRD", required_argument, 0, 'r'},
-        {0, 0, 0, 0}
-    };
-
-    // Simulated EEPROM data
-    char eepromData[EEPROM_SIZE];
-    memset(eepromData, 0, EEPROM_SIZE);
-
-    // Load EEPROM data from file or initialize it if the file doesn't exist
-    FILE *eepromFile = fopen(EEPROM_FILE_PATH, "rb");
-    if (eepromFile) {
-        fread(eepromData, 1, sizeof(eepromData), eepromFile);
-        fclose(eepromFile);
-    } else {
-        // Initialize EEPROM data with zeros
-        memset(eepromData, 0, sizeof(eepromData));
+    struct option long_options[FIELD_COUNT * 2 + sizeof(toolOptions) / sizeof(toolOptions[0]) + 1];
+    char shortOptions[sizeof(toolShortOptions) + EEPROM_FIELD_SHORT_OPTIONS];
+    memcpy(shortOptions, toolShortOptions, sizeof(toolShortOptions));
+    int fieldOptionCount = eepromFieldOptions(long_options, shortOptions);
+    memcpy(long_options + fieldOptionCount, toolOptions, sizeof(toolOptions));
+
+    // Layout and storage options must be known before the image is opened
+    const EepromLayout *layout = EEPROM_DEFAULT_LAYOUT;
+    const char *imagePath = EEPROM_FILE_PATH;
+    long imageSize = EEPROM_SIZE;
+    int atomicCommit = 0;
+    const char *bulkInput = NULL;
+    const char *bulkOutDir = NULL;
+    const char *bulkPack = NULL;
+    long bulkWorkers = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *macPoolPath = NULL;
+    const char *macPoolRange = NULL;
+    const char *metricsPath = NULL;
+    const char *comparePath = NULL;
+    const char *auditDir = NULL;
+    const char *catalogPath = NULL;
+    const char *indexDir = NULL;
+    const char *lookups[argc];
+    int lookupCount = 0;
+    int duplicates = 0;
+    const char *archivePath = NULL;
+    const char *appends[argc];
+    int appendCount = 0;
+    const char *templatePath = NULL;
+    const char *extractName = NULL;
+    int stream = 0;
+    int dumpRequested = 0;
+    HexDumpOptions dumpOptions = HEXDUMP_DEFAULT_OPTIONS;
+    char *rangeEnd;
+    opterr = 0;
+    while ((option = getopt_long_only(argc, argv, shortOptions, long_options, NULL)) != -1) {
+        if (option == 'L') {
+            layout = findEepromLayout(optarg);
+            if (layout == NULL) {
+                printf("Unknown layout %s.\n", optarg);
+                return 1;
+            }
+        } else if (option == 'f') {
+            imagePath = optarg;
+        } else if (option == 'z') {
+            imageSize = strtol(optarg, NULL, 0);
+        } else if (option == 'a') {
+            atomicCommit = 1;
+        } else if (option == 'B') {
+            bulkInput = optarg;
+        } else if (option == 'o') {
+            bulkOutDir = optarg;
+        } else if (option == 'k') {
+            bulkPack = optarg;
+        } else if (option == 'P') {
+            macPoolPath = optarg;
+        } else if (option == 'I') {
+            macPoolRange = optarg;
+        } else if (option == 'C') {
+            comparePath = optarg;
+        } else if (option == 'A') {
+            auditDir = optarg;
+        } else if (option == 'Q') {
+            catalogPath = optarg;
+        } else if (option == 'N') {
+            indexDir = optarg;
+        } else if (option == 'O') {
+            lookups[lookupCount++] = optarg;
+        } else if (option == 'D') {
+            duplicates = 1;
+        } else if (option == 'Y') {
+            archivePath = optarg;
+        } else if (option == 'H') {
+            appends[appendCount++] = optarg;
+        } else if (option == 'J') {
+            templatePath = optarg;
+        } else if (option == 'E') {
+            extractName = optarg;
+        } else if (option == 'W') {
+            stream = 1;
+        } else if (option == 'R') {
+            // Dump only <start>[:<length>]
+            dumpOptions.start = strtoul(optarg, &rangeEnd, 0);
+            dumpOptions.length = (*rangeEnd == ':') ? strtoul(rangeEnd + 1, NULL, 0) : 0;
+            dumpRequested = 1;
+        } else if (option == 'w') {
+            // Bytes per dump row
+            dumpOptions.width = atoi(optarg);
+            if (dumpOptions.width < 1 || dumpOptions.width > HEXDUMP_MAX_WIDTH) {
+                printf("Invalid dump width. Must be between 1 and %d.\n", HEXDUMP_MAX_WIDTH);
+                dumpOptions.width = HEXDUMP_DEFAULT_WIDTH;
+            }
+            dumpRequested = 1;
+        } else if (option == 'S') {
+            // Collapse repeated dump rows
+            dumpOptions.squeeze = 1;
+            dumpRequested = 1;
+        } else if (option == 'M') {
+            // Machine-readable dump rows
+            dumpOptions.machine = 1;
+            dumpRequested = 1;
+        } else if (option == 'X') {
+            metricsPath = optarg;
+            eepromMetricsEnabled = 1;
+        } else if (option == 'j') {
+            bulkWorkers = atoi(optarg);
+            if (bulkWorkers < 1 || bulkWorkers > 256) {
+                printf("Invalid number of jobs. Must be between 1 and 256.\n");
+                return 1;
+            }
+        }
     }
+    optind = 0;
+    opterr = 1;
 
-    while ((option = getopt_long_only(argc, argv, "s:b:p:m:cdenr:", long_options, NULL)) != -1) {
-        switch (option) {
-            case 's':
-                // Update Serial Number
-                if (strlen(optarg) == SERIAL_NUMBER_LENGTH) {
-                    strncpy(eepromData + SERIAL_NUMBER_OFFSET, optarg, SERIAL_NUMBER_LENGTH);
-                    printf("Serial Number updated successfully: %s\n", optarg);
-                    printHexDump(eepromData, sizeof(eepromData));
-    
-                    // Save EEPROM data to the file
-                    eepromFile = fopen(EEPROM_FILE_PATH, "wb");
-                    if (eepromFile) {
-                        fwrite(eepromData, 1, sizeof(eepromData), eepromFile);
-                        fclose(eepromFile);
-                    } else {
-                        perror("Failed to save EEPROM data");
-                    }
-                } else {
-                    printf("Serial Number has an incorrect length.\n");
-                }
-                break;
-            case 'b':
-                // Update Board Serial Number
-                if (strlen(optarg) == PCB_SERIAL_NUMBER_LENGTH) {
-                    strncpy(eepromData + PCB_SERIAL_NUMBER_OFFSET, optarg, PCB_SERIAL_NUMBER_LENGTH);
-                    printf("Board Serial Number updated successfully: %s\n", optarg);
-                    printHexDump(eepromData, sizeof(eepromData));
-    
-                    // Save EEPROM data to the file
-                    eepromFile = fopen(EEPROM_FILE_PATH, "wb");
-                    if (eepromFile) {
-                        fwrite(eepromData, 1, sizeof(eepromData), eepromFile);
-                        fclose(eepromFile);
-                    } else {
-                        perror("Failed to save EEPROM data");
-                    }
+    if (imageSize < (long)layout->end) {
+        printf("Invalid image size. Must be at least %u bytes.\n", layout->end);
+        return 1;
+    }
+
+    // MAC ID counts are allocated from the shared pool
+    static MacPool macPool;
+    if (macPoolRange && !macPoolPath) {
+        printf("--macPoolInit needs --macPool <file>.\n");
+        return 1;
+    }
+    if (macPoolPath) {
+        if (macPoolSetup(&macPool, macPoolPath, macPoolRange) != 0) {
+            return 1;
+        }
+        eepromMacPool = &macPool;
+    }
+
+    // Bulk mode builds one image per input record and exits
+    if (bulkInput) {
+        if ((bulkOutDir == NULL) == (bulkPack == NULL)) {
+            printf("Bulk mode needs exactly one of --out <dir> or --pack <file>.\n");
+            return 1;
+        }
+        return runBulk(bulkInput, bulkOutDir, bulkPack, layout, imageSize, bulkWorkers > 0 ? (int)bulkWorkers : 1);
+    }
+
+    // Compare mode diffs the image, or a directory of images, against a golden image and exits
+    if (auditDir && !comparePath) {
+        printf("--audit needs --compare <golden image>.\n");
+        return 1;
+    }
+    if (comparePath) {
+        return auditDir ? runAudit(comparePath, auditDir, layout, bulkWorkers > 0 ? (int)bulkWorkers : 1)
+                        : runCompare(comparePath, imagePath, layout);
+    }
+
+    // Catalog mode indexes image collections and answers lookups, then exits
+    if ((indexDir || lookupCount || duplicates) && !catalogPath) {
+        printf("--index, --lookup and --duplicates need --catalog <file>.\n");
+        return 1;
+    }
+    if (catalogPath) {
+        return runCatalog(catalogPath, indexDir, lookups, lookupCount, duplicates, layout);
+    }
+
+    // Archive mode appends, extracts or streams packed images, then exits
+    if ((appendCount || templatePath || extractName || stream) && !archivePath) {
+        printf("--append, --template, --extract and --stream need --archive <file>.\n");
+        return 1;
+    }
+    if (archivePath) {
+        int status = runArchive(archivePath, appends, appendCount, templatePath, imageSize, extractName, bulkOutDir,
+                                stream, &dumpOptions);
+        if (metricsPath && eepromMetricsWrite(metricsPath, "eeprom_tool") != 0) {
+            status = 1;
+        }
+        return status;
+    }
+
+    // Simulated EEPROM data, mapped from the image file
+    EepromStore store;
+    uint64_t metricStart = eepromMetricStart();
+    int opened = eepromStoreOpen(&store, imagePath, imageSize, atomicCommit) == 0;
+    eepromMetricRecord(METRIC_LOAD, metricStart, opened ? imageSize : 0, 1, 0, !opened);
+    if (!opened) {
+        if (metricsPath) {
+            eepromMetricsWrite(metricsPath, "eeprom_tool");
+        }
+        return 1;
+    }
+    char *eepromData = store.data;
+
+    // Verify the parameter block on load. A bad block keeps its stored
+    // checksum as the base for patches, so updates never hide the damage.
+    uint32_t checksum;
+    uint32_t storedChecksum = eepromGetU32(eepromData + layout->offset[FIELD_CHECKSUM]);
+    int checksumStatus = eepromChecksumVerify(layout, eepromData, &checksum);
+    if (checksumStatus == CHECKSUM_BAD) {
+        fprintf(stderr, "Warning: parameter block checksum mismatch (stored 0x%08X, computed 0x%08X)\n", storedChecksum, checksum);
+        checksum = storedChecksum;
+    }
+    int status = 0;
+
+    // Latest log values, rebuilt from one pass over the log area
+    EepromLog recordLog;
+    eepromLogScan(&recordLog, layout, eepromData, imageSize);
+    int logKey;
+    uint64_t logValue;
+
+    // All options are applied to the image and committed once at the end
+    int showDump = 1;
+
+    char fieldData[EEPROM_LAYOUT_LIMIT];
+    int clear;
+
+    while ((option = getopt_long_only(argc, argv, shortOptions, long_options, NULL)) != -1) {
+        // Update and clear options are generated from the field table
+        int field = eepromFieldForOption(option, &clear);
+        if (field >= 0) {
+            unsigned int offset = layout->offset[field];
+            if (clear) {
+                applyField(&store, layout, &checksum, offset, NULL, eepromFields[field].length);
+                eepromFieldCleared(field);
+            } else {
+                int length = eepromFieldEncode(field, optarg, fieldData);
+                if (length > 0) {
+                    applyField(&store, layout, &checksum, offset, fieldData, length);
                 } else {
-                    printf("Board Serial Number has an incorrect length.\n");
+                    status = 1;
                 }
-                break;
-            case 'p':
-                // Update Product ID
-                if (strlen(optarg) == PRODUCT_ID_LENGTH) {
-                    strncpy(eepromData + PRODUCT_ID_OFFSET, optarg, PRODUCT_ID_LENGTH);
-                    printf("Product ID updated successfully: %s\n", optarg);
-                    printHexDump(eepromData, sizeof(eepromData));
-    
-                    // Save EEPROM data to the file
-                    eepromFile = fopen(EEPROM_FILE_PATH, "wb");
-                    if (eepromFile) {
-                        fwrite(eepromData, 1, sizeof(eepromData), eepromFile);
-                        fclose(eepromFile);
-                    } else {
-                        perror("Failed to save EEPROM data");
-                    }
+            }
+            continue;
+        }
+
+        switch (option) {
+            case 'r':
+                // Read parameter
+                field = eepromFieldForKey(optarg);
+                if (field >= 0) {
+                    eepromFieldPrint(field, eepromData + layout->offset[field]);
                 } else {
-                    printf("Product ID has an incorrect length.\n");
+                    printf("Invalid argument for -updRD.\n");
                 }
                 break;
-            case 'm':
-                // Update MAC IDs
-                if (optarg[0] >= '0' && optarg[0] <= '9') {
-                    int macIdCount = atoi(optarg);
-                    if (macIdCount >= 1 && macIdCount <= MAC_ID_COUNT) {
-                        char macId[MAC_ID_LENGTH + 1];
-                        for (int i = 0; i < macIdCount; i++) {
-                            snprintf(macId, sizeof(macId), "A0:FC:72:00:53:%02X", i + 1);
-                            strncpy(eepromData + MAC_ID_OFFSET + i * MAC_ID_LENGTH, macId, MAC_ID_LENGTH);
-                            printf("MAC ID %d updated successfully: %s\n", i + 1, macId);
-                            printHexDump(eepromData, sizeof(eepromData));
-                        }
-    
-                        // Save EEPROM data to the file
-                        eepromFile = fopen(EEPROM_FILE_PATH, "wb");
-                        if (eepromFile) {
-                            fwrite(eepromData, 1, sizeof(eepromData), eepromFile);
-                            fclose(eepromFile);
-                        } else {
-                            perror("Failed to save EEPROM data");
-                        }
-                    } else {
-                        printf("Invalid number of MAC IDs. Must be between 1 and %d.\n", MAC_ID_COUNT);
-                    }
+            case 'V':
+                // Verify the parameter block checksum
+                if (checksumStatus == CHECKSUM_BAD) {
+                    printf("Checksum mismatch.\n");
+                    status = 2;
                 } else {
-                    printf("Invalid argument for -updMACID.\n");
+                    printf(checksumStatus == CHECKSUM_BLANK ? "Checksum: blank parameter block.\n" : "Checksum OK.\n");
                 }
                 break;
-            case 'c':
-                // Clear Serial Number
-                memset(eepromData + SERIAL_NUMBER_OFFSET, 0, SERIAL_NUMBER_LENGTH);
-                printf("Serial Number cleared.\n");
-                // Save EEPROM data to the file
-                eepromFile = fopen(EEPROM_FILE_PATH, "wb");
-                if (eepromFile) {
-                    fwrite(eepromData, 1, sizeof(eepromData), eepromFile);
-                    fclose(eepromFile);
-                } else {
-                    perror("Failed to save EEPROM data");
+            case 'U':
+                // Append a value to the record log
+                if (eepromLogParse(optarg, &logKey, &logValue) != 0) {
+                    printf("Invalid argument for --logSet. Use <key>=<value>.\n");
+                    status = 1;
+                } else if (eepromLogSet(&recordLog, eepromData, logKey, logValue, storeLogWrite, &store) != 0) {
+                    status = 1;
                 }
-                printHexDump(eepromData, sizeof(eepromData));
                 break;
-            case 'd':
-                // Clear Board Serial Number
-                memset(eepromData + PCB_SERIAL_NUMBER_OFFSET, 0, PCB_SERIAL_NUMBER_LENGTH);
-                printf("Board Serial Number cleared.\n");
-                // Save EEPROM data to the file
-                eepromFile = fopen(EEPROM_FILE_PATH, "wb");
-                if (eepromFile) {
-                    fwrite(eepromData, 1, sizeof(eepromData), eepromFile);
-                    fclose(eepromFile);
+            case 'G':
+                // Read the latest value of a log key
+                logKey = atoi(optarg);
+                if (eepromLogGet(&recordLog, eepromData, logKey, &logValue) == 0) {
+                    printf("Log %d: %llu\n", logKey, (unsigned long long)logValue);
                 } else {
-                    perror("Failed to save EEPROM data");
+                    printf("Log %d: not set\n", logKey);
                 }
-                printHexDump(eepromData, sizeof(eepromData));
                 break;
-            case 'e':
-                // Clear Product ID
-                memset(eepromData + PRODUCT_ID_OFFSET, 0, PRODUCT_ID_LENGTH);
-                printf("Product ID cleared.\n");
-                // Save EEPROM data to the file
-                eepromFile = fopen(EEPROM_FILE_PATH, "wb");
-                if (eepromFile) {
-                    fwrite(eepromData, 1, sizeof(eepromData), eepromFile);
-                    fclose(eepromFile);
-                } else {
-                    perror("Failed to save EEPROM data");
-                }
-                printHexDump(eepromData, sizeof(eepromData));
+            case 'T':
+                // List every log key
+                eepromLogPrint(&recordLog, eepromData);
                 break;
-            case 'n':
-                // Clear MAC IDs
-                memset(eepromData + MAC_ID_OFFSET, 0, MAC_ID_COUNT * MAC_ID_LENGTH);
-                printf("MAC IDs cleared.\n");
-                // Save EEPROM data to the file
-                eepromFile = fopen(EEPROM_FILE_PATH, "wb");
-                if (eepromFile) {
-                    fwrite(eepromData, 1, sizeof(eepromData), eepromFile);
-                    fclose(eepromFile);
-                } else {
-                    perror("Failed to save EEPROM data");
-                }
-                printHexDump(eepromData, sizeof(eepromData));
+            case 'q':
+                // Suppress the final hex dump
+                showDump = 0;
                 break;
-            case 'r':
-                // Read parameter
-                if (strcmp(optarg, "SRNUM") == 0) {
-                    char serialNumber[SERIAL_NUMBER_LENGTH + 1];
-                    strncpy(serialNumber, eepromData + SERIAL_NUMBER_OFFSET, SERIAL_NUMBER_LENGTH);
-                    serialNumber[SERIAL_NUMBER_LENGTH] = '\0';
-                    printf("Serial Number: %s\n", serialNumber);
-                } else if (strcmp(optarg, "BSRNUM") == 0) {
-                    char boardSerialNumber[PCB_SERIAL_NUMBER_LENGTH + 1];
-                    strncpy(boardSerialNumber, eepromData + PCB_SERIAL_NUMBER_OFFSET, PCB_SERIAL_NUMBER_LENGTH);
-                    boardSerialNumber[PCB_SERIAL_NUMBER_LENGTH] = '\0';
-                    printf("Board Serial Number: %s\n", boardSerialNumber);
-                } else if (strcmp(optarg, "PID") == 0) {
-                    char productID[PRODUCT_ID_LENGTH + 1];
-                    strncpy(productID, eepromData + PRODUCT_ID_OFFSET, PRODUCT_ID_LENGTH);
-                    productID[PRODUCT_ID_LENGTH] = '\0';
-                    printf("Product ID: %s\n", productID);
-                } else if (strcmp(optarg, "MACID") == 0) {
-                    for (int i = 0; i < MAC_ID_COUNT; i++) {
-                        char macId[MAC_ID_LENGTH + 1];
-                        strncpy(macId, eepromData + MAC_ID_OFFSET + i * MAC_ID_LENGTH, MAC_ID_LENGTH);
-                        macId[MAC_ID_LENGTH] = '\0';
-                        printf("MAC ID %d: %s\n", i + 1, macId);
-                    }
-                } else {
-                    printf("Invalid argument for -updRD.\n");
-                }
+            case 'f':
+            case 'z':
+            case 'a':
+            case 'L':
+            case 'B':
+            case 'o':
+            case 'k':
+            case 'j':
+            case 'P':
+            case 'I':
+            case 'X':
+            case 'C':
+            case 'A':
+            case 'Q':
+            case 'N':
+            case 'O':
+            case 'D':
+            case 'Y':
+            case 'H':
+            case 'J':
+            case 'E':
+            case 'W':
+            case 'R':
+            case 'w':
+            case 'S':
+            case 'M':
+                // Layout, storage, bulk, dump and MAC pool options handled before processing
                 break;
             default:
                 // Print usage information for unknown options
-                printf("Usage: %s --updSRNUM <new_serial_number> --updBSRNUM <new_board_serial_number> --updPID <new_product_id> --updMACID <num_of_macids> --clearSRNUM --clearBSRNUM --clearPID --clearMACID --updRD <parameter>\n", argv[0]);
+                printf("Usage: %s --updSRNUM <new_serial_number> --updBSRNUM <new_board_serial_number> --updPID <new_product_id> --updMACID <num_of_macids> --clearSRNUM --clearBSRNUM --clearPID --clearMACID --updRD <parameter> --noDump --file <path> --size <bytes> --atomic --range <start>[:<length>] --width <bytes> --squeeze --machine --layout <name> --verify --bulk <input> --out <dir> --pack <file> --jobs <n> --macPool <file> --macPoolInit <range> --logSet <key>=<value> --logGet <key> --logList --metrics <file> --compare <golden> --audit <dir> --catalog <file> --index <dir> --lookup <KEY>=<value> --duplicates --archive <file> --append <image or dir> --template <image> --extract <name> --stream\n", argv[0]);
                 break;
         }
     }
 
-    // If no options were specified, print a hex dump of the simulated EEPROM data
-    if (argc == 1) {
-        printHexDump(eepromData, sizeof(eepromData));
+    // Store the patched checksum with the other changes
+    if (store.bytesChanged > 0) {
+        char checksumField[FIELD_LENGTH_CHECKSUM];
+        eepromPutU32(checksumField, checksum);
+        eepromStoreUpdate(&store, layout->offset[FIELD_CHECKSUM], checksumField, FIELD_LENGTH_CHECKSUM);
     }
 
-    return 0;
+    // Commit every change in a single pass over the file
+    metricStart = eepromMetricStart();
+    int committed = eepromStoreCommit(&store) == 0;
+    eepromMetricRecord(METRIC_SAVE, metricStart, committed ? store.bytesChanged : 0, 1, 0, !committed);
+    if (!committed) {
+        status = 1;
+    }
+
+    if (recordLog.compactions > 0) {
+        printf("Log area compacted %lu time(s).\n", recordLog.compactions);
+    }
+
+    // Updates that matched the stored value were skipped
+    int updated = store.bytesChanged + store.bytesSkipped > 0;
+    if (updated) {
+        printf("Image update: %zu bytes written, %zu bytes unchanged.\n", store.bytesChanged, store.bytesSkipped);
+    }
+
+    // Print one hex dump after updates, or when no options were specified
+    if (showDump && (updated || argc == 1 || dumpRequested)) {
+        metricStart = eepromMetricStart();
+        hexDumpToStream(stdout, eepromData, imageSize, &dumpOptions);
+        fflush(stdout);
+        eepromMetricRecord(METRIC_DUMP, metricStart, imageSize, 1, 0, 0);
+    }
+
+    eepromStoreClose(&store);
+
+    // Export the per-operation counters
+    if (metricsPath && eepromMetricsWrite(metricsPath, "eeprom_tool") != 0) {
+        status = 1;
+    }
+    return status;
 }
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../eeprom_crc32c.h"
+
+// Benchmark of the CRC32C kernels (bytewise table, slice-by-8, SSE4.2)
+// and of the incremental patch against a full recompute of the block.
+//
+// Build: gcc -O2 bench/bench_crc32c.c -o bench_crc32c
+// Usage: ./bench_crc32c [buffer_size] [iterations]
+
+typedef uint32_t (*CrcKernel)(uint32_t crc, const void *data, size_t length);
+
+static uint32_t bytewiseKernel(uint32_t crc, const void *data, size_t length) {
+    return crc32cBytewise(crc, data, length);
+}
+
+static double monotonicSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void runKernel(const char *name, CrcKernel kernel, const char *data, int size, int iterations) {
+    uint32_t crc = 0xFFFFFFFFu;
+
+    // Chain the iterations so none of them can be skipped
+    double start = monotonicSeconds();
+    for (int i = 0; i < iterations; i++) {
+        crc = kernel(crc, data, size);
+    }
+    double elapsed = monotonicSeconds() - start;
+
+    double megabytes = (double)size * iterations / (1024.0 * 1024.0);
+    fprintf(stderr, "%-12s %10.2f MB/s (check %08X)\n", name, megabytes / elapsed, crc);
+}
+
+int main(int argc, char *argv[]) {
+    int size = argc > 1 ? atoi(argv[1]) : 65536;
+    int iterations = argc > 2 ? atoi(argv[2]) : 2000;
+
+    char *data = malloc(size);
+    if (!data || size < 64) {
+        fprintf(stderr, "Need a buffer of at least 64 bytes\n");
+        return 1;
+    }
+    srand(1);
+    for (int i = 0; i < size; i++) {
+        data[i] = (char)rand();
+    }
+    crc32cInit();
+
+    fprintf(stderr, "buffer %d bytes x %d\n", size, iterations);
+    runKernel("bytewise", bytewiseKernel, data, size, iterations / 8 + 1);
+    runKernel("slice-by-8", crc32cSliceBy8, data, size, iterations);
+#if defined(__x86_64__) || defined(__i386__)
+    if (crc32cHardwareAvailable) {
+        runKernel("sse4.2", crc32cHardware, data, size, iterations);
+    }
+#endif
+
+    // Patch an 18 byte field in the middle of the buffer, as a field update does
+    char field[18];
+    size_t position = size / 2;
+    uint32_t crc = crc32c(data, size);
+    int patches = 100000;
+
+    double start = monotonicSeconds();
+    for (int i = 0; i < patches; i++) {
+        memcpy(field, data + position, sizeof(field));
+        field[i % sizeof(field)] ^= 0x5A;
+        crc = crc32cPatch(crc, size, position, data + position, field, sizeof(field));
+        memcpy(data + position, field, sizeof(field));
+    }
+    double patched = (monotonicSeconds() - start) / patches;
+
+    start = monotonicSeconds();
+    uint32_t full = 0;
+    for (int i = 0; i < patches / 100; i++) {
+        data[position] ^= (char)full;
+        full = crc32c(data, size);
+    }
+    double recomputed = (monotonicSeconds() - start) / (patches / 100);
+    crc = crc32cPatch(crc, size, position, field, data + position, 1);
+
+    fprintf(stderr, "patch 18 bytes: %8.3f us, full recompute: %8.3f us (%s)\n",
+            patched * 1e6, recomputed * 1e6, crc == crc32c(data, size) ? "match" : "MISMATCH");
+    (void)full;
+
+    free(data);
+    return 0;
+}
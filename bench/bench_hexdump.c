@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../eeprom_hexdump.h"
+
+// Benchmark of the buffered hex dump engine against the original
+// per-byte printHexDump. Output goes to /dev/null, results to stderr.
+//
+// Build: gcc -O2 bench/bench_hexdump.c -o bench_hexdump
+// Usage: ./bench_hexdump [image_size] [iterations]
+
+// Original implementation, kept here as the baseline
+void legacyPrintHexDump(const char *data, int length) {
+    printf("EEPROM Hex Dump:\n");
+
+    for (int i = 0; i < length; i++) {
+        if (i % 16 == 0) {
+            if (i > 0) {
+                printf("  ");
+                for (int j = i - 16; j < i; j++) {
+                    if (j >= 0) {
+                        char c = data[j];
+                        if (c >= 32 && c <= 126) {
+                            putchar(c);
+                        } else {
+                            putchar('.');
+                        }
+                    }
+                }
+                printf("\n");
+            }
+            printf("0x%04X: ", i);
+        }
+        printf("%02X ", (unsigned char)data[i]);
+    }
+
+    printf("\n");
+}
+
+static double monotonicSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    int size = argc > 1 ? atoi(argv[1]) : 65536;
+    int iterations = argc > 2 ? atoi(argv[2]) : 200;
+    HexDumpOptions options = HEXDUMP_DEFAULT_OPTIONS;
+
+    char *data = malloc(size);
+    if (!data) {
+        perror("malloc");
+        return 1;
+    }
+    srand(1);
+    for (int i = 0; i < size; i++) {
+        data[i] = (char)rand();
+    }
+
+    if (!freopen("/dev/null", "w", stdout)) {
+        perror("Failed to redirect stdout");
+        return 1;
+    }
+
+    double start = monotonicSeconds();
+    for (int i = 0; i < iterations; i++) {
+        legacyPrintHexDump(data, size);
+    }
+    double legacy = monotonicSeconds() - start;
+
+    start = monotonicSeconds();
+    for (int i = 0; i < iterations; i++) {
+        hexDumpToStream(stdout, data, size, &options);
+    }
+    double buffered = monotonicSeconds() - start;
+
+    double megabytes = (double)size * iterations / (1024.0 * 1024.0);
+    fprintf(stderr, "image %d bytes x %d\n", size, iterations);
+    fprintf(stderr, "printHexDump (legacy): %8.2f MB/s\n", megabytes / legacy);
+    fprintf(stderr, "hexDumpToStream:       %8.2f MB/s (%.1fx)\n", megabytes / buffered, legacy / buffered);
+
+    free(data);
+    return 0;
+}
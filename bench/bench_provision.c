@@ -0,0 +1,353 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The I2C cases drive the tool's own shadow and bus code
+#define main eepromI2cMain
+#include "../eeprom_i2c.c"
+#undef main
+
+#include "../eeprom_store.h"
+
+// Benchmark of the provisioning, read, dump and verify paths.
+//
+// Every case runs against the file backend (the mapped eeprom_data.bin
+// image used by eeprom_tool) and against a simulated I2C device, for
+// image sizes from 1 KiB to 256 KiB. Results go to stdout as JSON: one
+// object per case with ops/sec, latency percentiles and the read/write
+// syscalls of the process (syscr/syscw from /proc/self/io). I2C cases
+// also count bus transfers, one ioctl or write each on real hardware.
+// Tool output (dumps, read-back lines) goes to /dev/null.
+//
+// Build: gcc -O2 -pthread bench/bench_provision.c -o bench_provision
+// Usage: ./bench_provision [file_iterations] [i2c_iterations] [sim_bus] > results.json
+
+#define BENCH_IMAGE_PATH "bench_image.bin"
+#define BENCH_MIN_SIZE 1024
+#define BENCH_MAX_SIZE (256 * 1024)
+
+// Largest part reachable with 2-byte addressing
+#define BENCH_MAX_I2C_SIZE 65536
+
+typedef struct {
+    EepromStore store;
+    uint32_t checksum;
+    I2cBus bus;
+    EepromShadow *shadow;
+    char *buffer;
+    size_t size;
+    int field;
+} BenchContext;
+
+typedef void (*BenchOp)(BenchContext *context, int iteration);
+
+typedef struct {
+    unsigned long syscr;
+    unsigned long syscw;
+} SyscallCounts;
+
+static FILE *jsonOutput;
+static int jsonCases;
+
+// Two values per field. Updates start from a cleared field, so each one
+// writes the whole encoded value.
+static const char *benchValues[FIELD_COUNT][2] = {
+    [FIELD_SERIAL_NUMBER] = {"123456789012345678", "876543210987654321"},
+    [FIELD_PCB_SERIAL_NUMBER] = {"ABCDEFGHIJKLMNOPQR", "RQPONMLKJIHGFEDCBA"},
+    [FIELD_PRODUCT_ID] = {"PROD12345678", "PROD87654321"},
+    [FIELD_MAC_ID] = {"02:00:00:00:00:10/3", "02:00:00:00:00:20/2"},
+};
+
+static void readSyscalls(SyscallCounts *counts) {
+    char line[128];
+    FILE *io = fopen("/proc/self/io", "r");
+
+    memset(counts, 0, sizeof(*counts));
+    if (!io) {
+        return;
+    }
+    while (fgets(line, sizeof(line), io)) {
+        sscanf(line, "syscr: %lu", &counts->syscr);
+        sscanf(line, "syscw: %lu", &counts->syscw);
+    }
+    fclose(io);
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int count, double fraction) {
+    int index = (int)(fraction * (count - 1) + 0.5);
+    return sorted[index];
+}
+
+// Function to time one case and print its JSON object.
+// setup runs before every iteration and is not timed.
+static void runCase(const char *backend, const char *name, BenchContext *context, int iterations,
+                    BenchOp setup, BenchOp op) {
+    double *latencies = malloc(iterations * sizeof(double));
+    SyscallCounts before, after;
+    unsigned long transfers = 0;
+    double total = 0;
+
+    if (!latencies) {
+        return;
+    }
+    EepromSim *sim = strcmp(backend, "i2c-sim") == 0 ? context->bus.device : NULL;
+    if (sim) {
+        transfers = sim->transfers;
+    }
+    readSyscalls(&before);
+    for (int i = 0; i < iterations; i++) {
+        if (setup) {
+            setup(context, i);
+        }
+        double start = monotonicSeconds();
+        op(context, i);
+        latencies[i] = monotonicSeconds() - start;
+        total += latencies[i];
+    }
+    fflush(stdout);
+    readSyscalls(&after);
+    if (sim) {
+        transfers = sim->transfers - transfers;
+    }
+
+    qsort(latencies, iterations, sizeof(double), compareDoubles);
+    fprintf(jsonOutput,
+            "%s  {\"backend\": \"%s\", \"op\": \"%s\", \"imageSize\": %zu, \"iterations\": %d, "
+            "\"opsPerSec\": %.1f, \"p50Us\": %.2f, \"p90Us\": %.2f, \"p99Us\": %.2f, \"maxUs\": %.2f, "
+            "\"syscr\": %lu, \"syscw\": %lu, \"busTransfers\": %lu}",
+            jsonCases++ ? ",\n" : "", backend, name, context->size, iterations, iterations / total,
+            percentile(latencies, iterations, 0.50) * 1e6, percentile(latencies, iterations, 0.90) * 1e6,
+            percentile(latencies, iterations, 0.99) * 1e6, latencies[iterations - 1] * 1e6,
+            after.syscr - before.syscr, after.syscw - before.syscw, transfers);
+    fprintf(stderr, "%-8s %-12s %7zu bytes %12.1f ops/s\n", backend, name, context->size, iterations / total);
+    free(latencies);
+}
+
+// File backend, doing what one eeprom_tool run does for each option
+
+static void fileApply(BenchContext *context, int field, const char *data, unsigned int length) {
+    const EepromLayout *layout = eepromLayout;
+    unsigned int offset = layout->offset[field];
+    char previous[EEPROM_LAYOUT_LIMIT];
+    char checksumField[FIELD_LENGTH_CHECKSUM];
+
+    memcpy(previous, context->store.data + offset, length);
+    size_t changed = data ? eepromStoreUpdate(&context->store, offset, data, length)
+                          : eepromStoreFill(&context->store, offset, 0, length);
+    if (changed) {
+        context->checksum = eepromChecksumPatch(layout, context->checksum, offset, previous,
+                                                context->store.data + offset, length);
+        eepromPutU32(checksumField, context->checksum);
+        eepromStoreUpdate(&context->store, layout->offset[FIELD_CHECKSUM], checksumField, FIELD_LENGTH_CHECKSUM);
+    }
+    eepromStoreCommit(&context->store);
+    context->store.dirty.count = 0;
+}
+
+// Function to encode a benchmark value, a value the field rejects would
+// time the failure path instead of the update
+static int benchEncode(int field, int iteration, char *fieldData) {
+    int length = eepromFieldEncode(field, benchValues[field][iteration & 1], fieldData);
+
+    if (length <= 0) {
+        fprintf(stderr, "Cannot encode %s for %s\n", benchValues[field][iteration & 1], eepromFields[field].label);
+        exit(1);
+    }
+    return length;
+}
+
+static void fileUpdate(BenchContext *context, int iteration) {
+    char fieldData[EEPROM_LAYOUT_LIMIT];
+    int length = benchEncode(context->field, iteration, fieldData);
+
+    fileApply(context, context->field, fieldData, length);
+}
+
+static void fileSet(BenchContext *context, int iteration) {
+    (void)iteration;
+    fileUpdate(context, 0);
+}
+
+static void fileClear(BenchContext *context, int iteration) {
+    (void)iteration;
+    fileApply(context, context->field, NULL, eepromFields[context->field].length);
+}
+
+static void fileRead(BenchContext *context, int iteration) {
+    int field = iteration % FIELD_GENERATION;
+    eepromFieldPrint(field, context->store.data + eepromLayout->offset[field]);
+}
+
+static void fileDump(BenchContext *context, int iteration) {
+    (void)iteration;
+    printHexDump(context->store.data, context->size);
+}
+
+static void fileLoad(BenchContext *context, int iteration) {
+    EepromStore store;
+    uint32_t computed;
+    (void)iteration;
+
+    if (eepromStoreOpen(&store, BENCH_IMAGE_PATH, context->size, 0) == 0) {
+        eepromChecksumVerify(eepromLayout, store.data, &computed);
+        eepromStoreClose(&store);
+    }
+}
+
+static void fileSave(BenchContext *context, int iteration) {
+    EepromStore store;
+    (void)iteration;
+
+    if (eepromStoreOpen(&store, BENCH_IMAGE_PATH, context->size, 1) == 0) {
+        eepromStoreTouch(&store, 0, context->size);
+        eepromStoreCommit(&store);
+        eepromStoreClose(&store);
+    }
+}
+
+static void runFileCases(size_t size, int iterations) {
+    BenchContext context = {0};
+    uint32_t computed;
+
+    context.size = size;
+    unlink(BENCH_IMAGE_PATH);
+    if (eepromStoreOpen(&context.store, BENCH_IMAGE_PATH, size, 0) != 0) {
+        return;
+    }
+    eepromChecksumVerify(eepromLayout, context.store.data, &computed);
+    context.checksum = computed;
+
+    static const char *updateNames[FIELD_COUNT] = {"update-s", "update-b", "update-p", "update-m"};
+    for (context.field = 0; context.field < FIELD_GENERATION; context.field++) {
+        runCase("file", updateNames[context.field], &context, iterations, fileClear, fileUpdate);
+    }
+    context.field = FIELD_SERIAL_NUMBER;
+    runCase("file", "clear", &context, iterations, fileSet, fileClear);
+    runCase("file", "read", &context, iterations, NULL, fileRead);
+    runCase("file", "dump", &context, iterations / 10 + 1, NULL, fileDump);
+    eepromStoreClose(&context.store);
+
+    runCase("file", "load", &context, iterations, NULL, fileLoad);
+    runCase("file", "save", &context, iterations / 10 + 1, NULL, fileSave);
+    unlink(BENCH_IMAGE_PATH);
+}
+
+// Simulated I2C device, driven through the shadow like eeprom_i2c
+
+static void i2cApply(BenchContext *context, const char *data, int length) {
+    shadowUpdate(&context->bus, context->shadow, eepromLayout->offset[context->field], data, 0, length);
+    shadowFinish(&context->bus, context->shadow, NULL);
+    context->shadow->written = 0;
+}
+
+static void i2cUpdate(BenchContext *context, int iteration) {
+    char fieldData[EEPROM_LAYOUT_LIMIT];
+    int length = benchEncode(context->field, iteration, fieldData);
+
+    i2cApply(context, fieldData, length);
+}
+
+static void i2cSet(BenchContext *context, int iteration) {
+    (void)iteration;
+    i2cUpdate(context, 0);
+}
+
+static void i2cClear(BenchContext *context, int iteration) {
+    (void)iteration;
+    i2cApply(context, NULL, eepromFields[context->field].length);
+}
+
+// A cold shadow, as at the start of a tool run
+static void i2cForget(BenchContext *context, int iteration) {
+    (void)iteration;
+    memset(context->shadow, 0, sizeof(*context->shadow));
+}
+
+static void i2cRead(BenchContext *context, int iteration) {
+    int field = iteration % FIELD_GENERATION;
+    unsigned int offset = eepromLayout->offset[field];
+
+    if (shadowLoad(&context->bus, context->shadow, offset, eepromFields[field].length) == 0) {
+        eepromFieldPrint(field, context->shadow->data + offset);
+    }
+}
+
+static void i2cDump(BenchContext *context, int iteration) {
+    (void)iteration;
+    if (readDataFromEEPROM(&context->bus, 0, context->buffer, context->size) == 0) {
+        printHexDump(context->buffer, context->size);
+    }
+}
+
+static void i2cLoad(BenchContext *context, int iteration) {
+    (void)iteration;
+    shadowLoad(&context->bus, context->shadow, PARAMETER_REGION_OFFSET, PARAMETER_REGION_END - PARAMETER_REGION_OFFSET);
+}
+
+static void runI2cCases(size_t size, int iterations, const char *busPath) {
+    BenchContext context = {0};
+    EepromPart part = {"sim", size, size <= 8192 ? 32 : size <= 32768 ? 64 : 128, 2};
+
+    context.size = size;
+    context.shadow = calloc(1, sizeof(EepromShadow));
+    context.buffer = malloc(size);
+    eepromPageSize = part.pageSize;
+    eepromAddressBytes = part.addressBytes;
+    eepromPartSize = part.size;
+    if (!context.shadow || !context.buffer || openEEPROMBus(&context.bus, busPath, &part) != 0 ||
+        selectEEPROMDevice(&context.bus, EEPROM_I2C_ADDRESS) != 0 || detectAdapter(&context.bus, 0) != 0) {
+        fprintf(stderr, "Cannot open simulated bus %s\n", busPath);
+        exit(1);
+    }
+
+    static const char *updateNames[FIELD_COUNT] = {"update-s", "update-b", "update-p", "update-m"};
+    for (context.field = 0; context.field < FIELD_GENERATION; context.field++) {
+        runCase("i2c-sim", updateNames[context.field], &context, iterations, i2cClear, i2cUpdate);
+    }
+    context.field = FIELD_SERIAL_NUMBER;
+    runCase("i2c-sim", "clear", &context, iterations, i2cSet, i2cClear);
+    runCase("i2c-sim", "read", &context, iterations, i2cForget, i2cRead);
+    runCase("i2c-sim", "dump", &context, iterations / 10 + 1, NULL, i2cDump);
+    runCase("i2c-sim", "load", &context, iterations, i2cForget, i2cLoad);
+
+    i2cClose(&context.bus);
+    free(context.shadow);
+    free(context.buffer);
+}
+
+int main(int argc, char *argv[]) {
+    int fileIterations = argc > 1 ? atoi(argv[1]) : 1000;
+    int i2cIterations = argc > 2 ? atoi(argv[2]) : 20;
+    const char *busPath = argc > 3 ? argv[3] : "sim:clock=400k";
+
+    if (fileIterations < 1 || i2cIterations < 1 || !eepromSimPath(busPath)) {
+        fprintf(stderr, "Usage: %s [file_iterations] [i2c_iterations] [sim_bus]\n", argv[0]);
+        return 1;
+    }
+
+    // Keep stdout for JSON, send the tools' own output to /dev/null
+    jsonOutput = fdopen(dup(STDOUT_FILENO), "w");
+    if (!jsonOutput || !freopen("/dev/null", "w", stdout)) {
+        perror("Failed to redirect output");
+        return 1;
+    }
+    eepromFieldMessages = 0;
+    eepromLayout = &eepromLayouts[EEPROM_LAYOUT_INDEX_SIM];
+    crc32cInit();
+
+    fputs("[\n", jsonOutput);
+    for (size_t size = BENCH_MIN_SIZE; size <= BENCH_MAX_SIZE; size *= 4) {
+        runFileCases(size, fileIterations);
+    }
+    for (size_t size = BENCH_MIN_SIZE; size <= BENCH_MAX_I2C_SIZE; size *= 4) {
+        runI2cCases(size, i2cIterations, busPath);
+    }
+    fputs("\n]\n", jsonOutput);
+    fclose(jsonOutput);
+    return 0;
+}
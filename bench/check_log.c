@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../eeprom_log.h"
+
+// Power-cut check of the record log.
+//
+// Fills the log of the sim layout until the next update has to compact
+// it, then cuts the power at every write of that update in turn: the
+// write in flight is torn in half and nothing after it reaches the
+// image. After each cut the log is scanned again as on the next start,
+// and a run of further updates must keep every key at its last value.
+// Prints the first lost value and exits 1, or exits 0 when every cut
+// point passes.
+//
+// Build: gcc -O2 bench/check_log.c -o check_log
+// Usage: ./check_log [updates_after_cut]
+
+#define CHECK_IMAGE_SIZE EEPROM_LAYOUT_LIMIT
+
+// Keys kept live across the compaction, and the few updated between
+#define CHECK_KEYS 20
+#define CHECK_HOT_KEYS 5
+
+typedef struct {
+    char *image;
+    long budget;  // Writes left before the power cut, -1 for no cut
+    long written; // Writes completed
+} CheckTarget;
+
+static int checkWrite(void *context, unsigned int offset, const char *record, unsigned int length) {
+    CheckTarget *target = context;
+
+    if (target->budget == 0) {
+        memcpy(target->image + offset, record, length / 2);
+        return -1;
+    }
+    if (target->budget > 0) {
+        target->budget--;
+    }
+    memcpy(target->image + offset, record, length);
+    target->written++;
+    return 0;
+}
+
+// Function to compare every key of a fresh scan with the expected values
+static int checkValues(const EepromLayout *layout, const char *image, const uint64_t *expected, const char *when) {
+    EepromLog log;
+    uint64_t value;
+
+    eepromLogScan(&log, layout, image, CHECK_IMAGE_SIZE);
+    for (int key = EEPROM_LOG_KEY_MIN; key <= CHECK_KEYS; key++) {
+        if (eepromLogGet(&log, image, key, &value) != 0 || value != expected[key]) {
+            fprintf(stderr, "%s: key %d lost, expected %llu\n", when, key, (unsigned long long)expected[key]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int updates = argc > 1 ? atoi(argv[1]) : 200;
+    const EepromLayout *layout = &eepromLayouts[EEPROM_LAYOUT_INDEX_SIM];
+    static char filled[CHECK_IMAGE_SIZE], image[CHECK_IMAGE_SIZE];
+    uint64_t filledValues[EEPROM_LOG_KEYS] = {0}, expected[EEPROM_LOG_KEYS];
+    CheckTarget target = {filled, -1, 0};
+    EepromLog log;
+    char when[64];
+
+    if (updates < 1) {
+        fprintf(stderr, "Usage: %s [updates_after_cut]\n", argv[0]);
+        return 1;
+    }
+
+    // Every key once, then the hot keys until the area is full
+    memset(filled, 0xFF, sizeof(filled));
+    eepromLogScan(&log, layout, filled, CHECK_IMAGE_SIZE);
+    for (int key = EEPROM_LOG_KEY_MIN; key <= CHECK_KEYS; key++) {
+        filledValues[key] = key * 1000;
+        eepromLogSet(&log, filled, key, filledValues[key], checkWrite, &target);
+    }
+    for (uint64_t value = 1; log.head < log.slots; value++) {
+        int key = EEPROM_LOG_KEY_MIN + value % CHECK_HOT_KEYS;
+        filledValues[key] = value;
+        eepromLogSet(&log, filled, key, filledValues[key], checkWrite, &target);
+    }
+
+    // Count the writes of the update that compacts
+    memcpy(image, filled, sizeof(image));
+    target = (CheckTarget){image, -1, 0};
+    eepromLogScan(&log, layout, image, CHECK_IMAGE_SIZE);
+    if (eepromLogSet(&log, image, 1, 1u << 30, checkWrite, &target) != 0 || log.compactions != 1) {
+        fprintf(stderr, "Filled log did not compact\n");
+        return 1;
+    }
+    long compactWrites = target.written;
+
+    for (long cut = 0; cut < compactWrites; cut++) {
+        memcpy(image, filled, sizeof(image));
+        memcpy(expected, filledValues, sizeof(expected));
+        target = (CheckTarget){image, cut, 0};
+        eepromLogScan(&log, layout, image, CHECK_IMAGE_SIZE);
+        eepromLogSet(&log, image, 1, 1u << 30, checkWrite, &target);
+        snprintf(when, sizeof(when), "Cut at write %ld", cut);
+        if (checkValues(layout, image, expected, when) != 0) {
+            return 1;
+        }
+
+        // Restart and keep updating every key in turn
+        target = (CheckTarget){image, -1, 0};
+        eepromLogScan(&log, layout, image, CHECK_IMAGE_SIZE);
+        for (int i = 0; i < updates; i++) {
+            int key = EEPROM_LOG_KEY_MIN + i % CHECK_KEYS;
+            expected[key] = (uint64_t)cut << 32 | i;
+            if (eepromLogSet(&log, image, key, expected[key], checkWrite, &target) != 0) {
+                fprintf(stderr, "Cut at write %ld: update %d failed\n", cut, i);
+                return 1;
+            }
+            snprintf(when, sizeof(when), "Cut at write %ld, update %d", cut, i);
+            if (checkValues(layout, image, expected, when) != 0) {
+                return 1;
+            }
+        }
+    }
+    printf("Record log: %ld cut points, %d updates after each, no value lost\n", compactWrites, updates);
+    return 0;
+}
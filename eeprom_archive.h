@@ -0,0 +1,509 @@
+#ifndef EEPROM_ARCHIVE_H
+#define EEPROM_ARCHIVE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "eeprom_diff.h"
+
+// Packed archive of EEPROM images.
+//
+// The archive holds one template image and a delta record per member: the
+// runs of bytes where the member differs from the template. With an
+// all-zero template the records are sparse images; with a golden template
+// only the per-board fields are left. An offset table sorted by member name
+// follows the records, so the mapped archive finds a member by binary
+// search and decodes it on its own.
+//
+// An append writes the new records after the used space and the merged
+// table into the spare of two table slots, then commits by rewriting the
+// fixed-size header. A crash before the header is written leaves the
+// previous archive as it was. The slots double when they fill, so the
+// space they leave behind stays proportional to the table.
+
+#define ARCHIVE_MAGIC 0x52414545 // "EEAR"
+#define ARCHIVE_VERSION 1
+
+// Longest member name, including the terminating NUL
+#define ARCHIVE_NAME_MAX 256
+
+// Equal spans shorter than this are kept inside a run, a run header costs about as much
+#define ARCHIVE_RUN_GAP 4
+
+// Entries of the first table slots
+#define ARCHIVE_TABLE_MIN 1024
+
+// Records are encoded into a buffer of this size and written as it fills
+#define ARCHIVE_BUFFER (1 << 20)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t imageSize;      // Bytes of every member and of the template
+    uint32_t live;           // Table slot holding the current table, 0 or 1
+    uint64_t imageCount;
+    uint64_t templateOffset; // char[imageSize]
+    uint64_t tableCapacity;  // Entries each table slot holds
+    uint64_t tableOffset[2]; // uint64_t[tableCapacity] record offsets, sorted by member name
+    uint64_t end;            // End of the used space, where the next append writes
+} ArchiveHeader;
+
+// Record header, followed by the NUL-terminated name and the delta. The
+// delta is a list of runs: a varint gap from the end of the previous run,
+// a varint length and the bytes. Records are not aligned.
+typedef struct {
+    int64_t mtime;        // Of the appended file, in nanoseconds
+    uint32_t deltaLength;
+    uint16_t nameLength;  // Including the NUL
+    uint16_t reserved;
+} ArchiveRecord;
+
+// Mapped archive
+typedef struct {
+    void *map;
+    size_t length;
+    const ArchiveHeader *header;
+    const char *base;      // Template image
+    const uint64_t *table;
+} Archive;
+
+// Function to map an archive, returns -1 if it is missing or not an archive
+static inline int archiveOpen(Archive *archive, const char *path) {
+    struct stat info;
+    int fd = open(path, O_RDONLY);
+
+    memset(archive, 0, sizeof(*archive));
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || (size_t)info.st_size < sizeof(ArchiveHeader)) {
+        close(fd);
+        return -1;
+    }
+    archive->length = info.st_size;
+    archive->map = mmap(NULL, archive->length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (archive->map == MAP_FAILED) {
+        archive->map = NULL;
+        return -1;
+    }
+
+    const ArchiveHeader *header = archive->header = archive->map;
+    int valid = header->magic == ARCHIVE_MAGIC && header->version == ARCHIVE_VERSION && header->live < 2 &&
+                header->end <= archive->length && header->imageCount <= header->tableCapacity &&
+                header->templateOffset + header->imageSize <= header->end &&
+                header->tableOffset[header->live] % sizeof(uint64_t) == 0 &&
+                header->tableOffset[header->live] + header->imageCount * sizeof(uint64_t) <= header->end;
+    if (!valid) {
+        munmap(archive->map, archive->length);
+        archive->map = NULL;
+        return -1;
+    }
+    archive->base = (const char *)archive->map + header->templateOffset;
+    archive->table = (const uint64_t *)((const char *)archive->map + header->tableOffset[header->live]);
+    return 0;
+}
+
+static inline void archiveClose(Archive *archive) {
+    if (archive->map) {
+        munmap(archive->map, archive->length);
+        archive->map = NULL;
+    }
+}
+
+// Function to read a member's record header. Returns its delta, or NULL
+// when the record runs past the used space.
+static inline const char *archiveRecord(const Archive *archive, size_t index, ArchiveRecord *record) {
+    uint64_t offset = archive->table[index];
+    const char *data = (const char *)archive->map + offset;
+
+    if (offset + sizeof(ArchiveRecord) > archive->header->end) {
+        return NULL;
+    }
+    memcpy(record, data, sizeof(ArchiveRecord));
+    if (record->nameLength == 0 ||
+        offset + sizeof(ArchiveRecord) + record->nameLength + record->deltaLength > archive->header->end ||
+        data[sizeof(ArchiveRecord) + record->nameLength - 1] != '\0') {
+        return NULL;
+    }
+    return data + sizeof(ArchiveRecord) + record->nameLength;
+}
+
+// Function to get a member's name, "" if its record is damaged
+static inline const char *archiveName(const Archive *archive, size_t index) {
+    ArchiveRecord record;
+
+    if (!archiveRecord(archive, index, &record)) {
+        return "";
+    }
+    return (const char *)archive->map + archive->table[index] + sizeof(ArchiveRecord);
+}
+
+// Function to find a member by name, returns its index or -1
+static inline long archiveFind(const Archive *archive, const char *name) {
+    size_t low = 0, high = archive->header->imageCount;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        int order = strcmp(archiveName(archive, middle), name);
+        if (order == 0) {
+            return middle;
+        }
+        if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return -1;
+}
+
+static inline size_t archivePutVarint(char *out, uint64_t value) {
+    size_t length = 0;
+
+    while (value >= 0x80) {
+        out[length++] = (char)(value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = (char)value;
+    return length;
+}
+
+static inline int archiveGetVarint(const char *data, size_t length, size_t *position, uint64_t *value) {
+    *value = 0;
+    for (int shift = 0; shift < 64 && *position < length; shift += 7) {
+        unsigned char byte = data[(*position)++];
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Largest delta of an image of size bytes
+static inline size_t archiveDeltaBound(size_t size) {
+    return size + 20 * (size / (ARCHIVE_RUN_GAP + 1) + 1);
+}
+
+// Function to encode the runs where an image differs from the template.
+// out must hold archiveDeltaBound(size) bytes. Returns the delta length.
+static inline size_t archiveEncode(const char *image, const char *base, size_t size, char *out) {
+    size_t used = 0, previousEnd = 0;
+    size_t position = eepromDiffNext(image, base, 0, size);
+
+    while (position < size) {
+        size_t end = eepromDiffRunEnd(image, base, position, size);
+        size_t next = eepromDiffNext(image, base, end, size);
+        while (next < size && next - end < ARCHIVE_RUN_GAP) {
+            end = eepromDiffRunEnd(image, base, next, size);
+            next = eepromDiffNext(image, base, end, size);
+        }
+        used += archivePutVarint(out + used, position - previousEnd);
+        used += archivePutVarint(out + used, end - position);
+        memcpy(out + used, image + position, end - position);
+        used += end - position;
+        previousEnd = end;
+        position = next;
+    }
+    return used;
+}
+
+// Function to apply a delta to an image holding the template. Returns -1
+// if the delta is damaged.
+static inline int archiveDecode(const char *delta, size_t length, char *image, size_t size) {
+    size_t used = 0, position = 0;
+
+    while (used < length) {
+        uint64_t gap, run;
+        if (archiveGetVarint(delta, length, &used, &gap) != 0 || archiveGetVarint(delta, length, &used, &run) != 0 ||
+            gap > size - position || run > size - position - gap || run > length - used) {
+            return -1;
+        }
+        position += gap;
+        memcpy(image + position, delta + used, run);
+        position += run;
+        used += run;
+    }
+    return 0;
+}
+
+// Function to decode a member into image, which holds imageSize bytes
+static inline int archiveExtract(const Archive *archive, size_t index, char *image) {
+    ArchiveRecord record;
+    const char *delta = archiveRecord(archive, index, &record);
+
+    if (!delta) {
+        return -1;
+    }
+    memcpy(image, archive->base, archive->header->imageSize);
+    return archiveDecode(delta, record.deltaLength, image, archive->header->imageSize);
+}
+
+// Function to write all of a buffer at an offset
+static inline int archiveWriteAt(int fd, const void *data, size_t length, uint64_t offset) {
+    const char *bytes = data;
+
+    while (length > 0) {
+        ssize_t put = pwrite(fd, bytes, length, offset);
+        if (put < 0) {
+            return -1;
+        }
+        bytes += put;
+        length -= put;
+        offset += put;
+    }
+    return 0;
+}
+
+// Function to create an empty archive with a template of imageSize bytes.
+// An existing file is never overwritten.
+static inline int archiveCreate(const char *path, const char *base, uint32_t imageSize) {
+    ArchiveHeader header;
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    memset(&header, 0, sizeof(header));
+    header.magic = ARCHIVE_MAGIC;
+    header.version = ARCHIVE_VERSION;
+    header.imageSize = imageSize;
+    header.templateOffset = sizeof(header);
+    header.end = header.templateOffset + imageSize;
+    int ok = archiveWriteAt(fd, &header, sizeof(header), 0) == 0 &&
+             archiveWriteAt(fd, base, imageSize, header.templateOffset) == 0 && fsync(fd) == 0;
+    if (close(fd) != 0 || !ok) {
+        perror(path);
+        unlink(path);
+        return -1;
+    }
+    return 0;
+}
+
+// Member being appended, its record is written at offset
+typedef struct {
+    char *name;
+    uint64_t offset;
+} ArchivePending;
+
+// Records being appended past the used space of the archive
+typedef struct {
+    int fd;
+    uint64_t offset; // Where the buffer goes
+    char *records;
+    size_t length, capacity;
+    ArchivePending *pending;
+    size_t count, pendingCapacity;
+    unsigned long skipped;
+} ArchiveBuilder;
+
+static inline int archiveFlush(ArchiveBuilder *builder) {
+    if (archiveWriteAt(builder->fd, builder->records, builder->length, builder->offset) != 0) {
+        return -1;
+    }
+    builder->offset += builder->length;
+    builder->length = 0;
+    return 0;
+}
+
+static inline int archiveComparePending(const void *a, const void *b) {
+    return strcmp(((const ArchivePending *)a)->name, ((const ArchivePending *)b)->name);
+}
+
+// Function to encode one image file into the builder. Files of another
+// size than the archive's images are skipped.
+static inline int archiveAddFile(ArchiveBuilder *builder, const Archive *archive, int dirFd, const char *path,
+                                 const char *name, char *image) {
+    size_t imageSize = archive->header->imageSize;
+    size_t nameLength = strlen(name) + 1;
+    struct stat info;
+    int fd = openat(dirFd, path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || (size_t)info.st_size != imageSize ||
+        nameLength > ARCHIVE_NAME_MAX || pread(fd, image, imageSize, 0) != (ssize_t)imageSize) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        builder->skipped++;
+        return 0;
+    }
+    close(fd);
+
+    size_t bound = sizeof(ArchiveRecord) + nameLength + archiveDeltaBound(imageSize);
+    if (builder->length + bound > builder->capacity && archiveFlush(builder) != 0) {
+        return -1;
+    }
+    if (builder->count == builder->pendingCapacity) {
+        size_t grown = builder->pendingCapacity ? builder->pendingCapacity * 2 : 1024;
+        ArchivePending *resized = realloc(builder->pending, grown * sizeof(ArchivePending));
+        if (!resized) {
+            return -1;
+        }
+        builder->pending = resized;
+        builder->pendingCapacity = grown;
+    }
+
+    char *out = builder->records + builder->length;
+    ArchiveRecord record = {(int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec, 0, nameLength, 0};
+    memcpy(out + sizeof(record), name, nameLength);
+    record.deltaLength = archiveEncode(image, archive->base, imageSize, out + sizeof(record) + nameLength);
+    memcpy(out, &record, sizeof(record));
+
+    builder->pending[builder->count].name = strdup(name);
+    builder->pending[builder->count].offset = builder->offset + builder->length;
+    if (!builder->pending[builder->count].name) {
+        return -1;
+    }
+    builder->count++;
+    builder->length += sizeof(record) + nameLength + record.deltaLength;
+    return 0;
+}
+
+// Function to encode an image file, or every image file of a directory
+static inline int archiveAddPath(ArchiveBuilder *builder, const Archive *archive, const char *path, char *image) {
+    struct stat info;
+
+    if (stat(path, &info) != 0) {
+        perror(path);
+        return -1;
+    }
+    if (!S_ISDIR(info.st_mode)) {
+        const char *name = strrchr(path, '/');
+        return archiveAddFile(builder, archive, AT_FDCWD, path, name ? name + 1 : path, image);
+    }
+
+    DIR *dir = opendir(path);
+    struct dirent *entry;
+    int status = 0;
+    if (!dir) {
+        perror(path);
+        return -1;
+    }
+    while (status == 0 && (entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] != '.') {
+            status = archiveAddFile(builder, archive, dirfd(dir), entry->d_name, entry->d_name, image);
+        }
+    }
+    closedir(dir);
+    return status;
+}
+
+// Function to append image files, or every image file of the given
+// directories, to an archive. Members are named by file name. Files of
+// another size and names already in the archive are skipped.
+static inline int archiveAppend(const char *path, const char **inputs, int inputCount) {
+    Archive archive;
+    ArchiveBuilder builder;
+    int status = 0;
+
+    if (archiveOpen(&archive, path) != 0) {
+        fprintf(stderr, "%s is not an archive\n", path);
+        return -1;
+    }
+    memset(&builder, 0, sizeof(builder));
+    builder.offset = archive.header->end;
+    builder.capacity = sizeof(ArchiveRecord) + ARCHIVE_NAME_MAX + archiveDeltaBound(archive.header->imageSize);
+    if (builder.capacity < ARCHIVE_BUFFER) {
+        builder.capacity = ARCHIVE_BUFFER;
+    }
+    builder.records = malloc(builder.capacity);
+    builder.fd = open(path, O_RDWR);
+    char *image = malloc(archive.header->imageSize);
+    if (!builder.records || !image || builder.fd < 0) {
+        status = -1;
+    }
+    for (int i = 0; i < inputCount && status == 0; i++) {
+        status = archiveAddPath(&builder, &archive, inputs[i], image);
+    }
+    if (status == 0) {
+        status = archiveFlush(&builder);
+    }
+    free(image);
+
+    // New members are merged into the sorted table; repeated names keep the first
+    if (builder.count > 0) {
+        qsort(builder.pending, builder.count, sizeof(ArchivePending), archiveComparePending);
+    }
+    const ArchiveHeader *old = archive.header;
+    uint64_t count = old->imageCount;
+    uint64_t *table = malloc((old->imageCount + builder.count + 1) * sizeof(uint64_t));
+    size_t oldIndex = 0;
+    for (size_t i = 0; i < builder.count && status == 0 && table; i++) {
+        const char *name = builder.pending[i].name;
+        if ((i > 0 && strcmp(builder.pending[i - 1].name, name) == 0) || archiveFind(&archive, name) >= 0) {
+            builder.skipped++;
+            continue;
+        }
+        while (oldIndex < old->imageCount && strcmp(archiveName(&archive, oldIndex), name) < 0) {
+            table[oldIndex + (count - old->imageCount)] = archive.table[oldIndex];
+            oldIndex++;
+        }
+        table[oldIndex + (count - old->imageCount)] = builder.pending[i].offset;
+        count++;
+    }
+    while (table && oldIndex < old->imageCount) {
+        table[oldIndex + (count - old->imageCount)] = archive.table[oldIndex];
+        oldIndex++;
+    }
+    if (!table) {
+        status = -1;
+    }
+
+    // The records are past the used space and the table goes to a slot the
+    // current header does not use, so the header write commits the append
+    ArchiveHeader header = *old;
+    header.imageCount = count;
+    header.end = builder.offset;
+    if (count > header.tableCapacity) {
+        header.tableCapacity = header.tableCapacity ? header.tableCapacity : ARCHIVE_TABLE_MIN;
+        while (header.tableCapacity < count) {
+            header.tableCapacity *= 2;
+        }
+        header.tableOffset[0] = (header.end + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t);
+        header.tableOffset[1] = header.tableOffset[0] + header.tableCapacity * sizeof(uint64_t);
+        header.end = header.tableOffset[1] + header.tableCapacity * sizeof(uint64_t);
+        header.live = 0;
+    } else {
+        header.live = !old->live;
+    }
+    unsigned long added = count - old->imageCount;
+    archiveClose(&archive);
+
+    if (status == 0 && added > 0) {
+        int fd = builder.fd;
+        int ok = archiveWriteAt(fd, table, count * sizeof(uint64_t), header.tableOffset[header.live]) == 0 &&
+                 ftruncate(fd, header.end) == 0 && fsync(fd) == 0 &&
+                 archiveWriteAt(fd, &header, sizeof(header), 0) == 0 && fsync(fd) == 0;
+        if (!ok) {
+            status = -1;
+        }
+    }
+    if (builder.fd >= 0 && close(builder.fd) != 0) {
+        status = -1;
+    }
+    if (status != 0) {
+        perror("Failed to append to archive");
+    } else {
+        printf("Archive: %llu images, %lu added, %lu skipped\n", (unsigned long long)count, added, builder.skipped);
+    }
+
+    for (size_t i = 0; i < builder.count; i++) {
+        free(builder.pending[i].name);
+    }
+    free(builder.pending);
+    free(builder.records);
+    free(table);
+    return status;
+}
+
+#endif // EEPROM_ARCHIVE_H
@@ -0,0 +1,109 @@
+#ifndef EEPROM_BUS_H
+#define EEPROM_BUS_H
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <sys/ioctl.h>
+
+// Bus backends under the EEPROM transfer code.
+//
+// The operations mirror the i2c-dev calls the tool makes: select the slave
+// address, query the adapter functions, plain writes, combined I2C_RDWR
+// transfers and SMBus transactions. Each returns what the i2c-dev call
+// would and sets errno the same way, so the page, polling and fallback
+// logic above runs unchanged against real hardware or a simulated device.
+
+typedef struct I2cBus I2cBus;
+
+typedef struct {
+    const char *name;
+    int (*setSlave)(I2cBus *bus, unsigned short address);
+    int (*functions)(I2cBus *bus, unsigned long *funcs);
+    ssize_t (*write)(I2cBus *bus, const void *data, size_t length);
+    int (*transfer)(I2cBus *bus, struct i2c_msg *messages, int count);
+    int (*smbus)(I2cBus *bus, char readWrite, unsigned char command, int size, union i2c_smbus_data *data);
+    void (*close)(I2cBus *bus);
+} I2cBackend;
+
+struct I2cBus {
+    const I2cBackend *backend;
+    int fd;       // i2c-dev file of the hardware backend
+    void *device; // State of other backends
+    const char *path; // As opened, names the bus in persisted state
+};
+
+static inline int i2cSetSlave(I2cBus *bus, unsigned short address) {
+    return bus->backend->setSlave(bus, address);
+}
+
+static inline int i2cFunctions(I2cBus *bus, unsigned long *funcs) {
+    return bus->backend->functions(bus, funcs);
+}
+
+static inline ssize_t i2cWrite(I2cBus *bus, const void *data, size_t length) {
+    return bus->backend->write(bus, data, length);
+}
+
+static inline int i2cTransfer(I2cBus *bus, struct i2c_msg *messages, int count) {
+    return bus->backend->transfer(bus, messages, count);
+}
+
+static inline int i2cSmbus(I2cBus *bus, char readWrite, unsigned char command, int size, union i2c_smbus_data *data) {
+    return bus->backend->smbus(bus, readWrite, command, size, data);
+}
+
+static inline void i2cClose(I2cBus *bus) {
+    bus->backend->close(bus);
+}
+
+// Hardware backend: a Linux i2c-dev adapter such as /dev/i2c-1
+
+static inline int i2cDevSetSlave(I2cBus *bus, unsigned short address) {
+    return ioctl(bus->fd, I2C_SLAVE, address);
+}
+
+static inline int i2cDevFunctions(I2cBus *bus, unsigned long *funcs) {
+    return ioctl(bus->fd, I2C_FUNCS, funcs);
+}
+
+static inline ssize_t i2cDevWrite(I2cBus *bus, const void *data, size_t length) {
+    return write(bus->fd, data, length);
+}
+
+static inline int i2cDevTransfer(I2cBus *bus, struct i2c_msg *messages, int count) {
+    struct i2c_rdwr_ioctl_data transfer = {messages, count};
+    return ioctl(bus->fd, I2C_RDWR, &transfer);
+}
+
+static inline int i2cDevSmbus(I2cBus *bus, char readWrite, unsigned char command, int size, union i2c_smbus_data *data) {
+    struct i2c_smbus_ioctl_data args;
+
+    args.read_write = readWrite;
+    args.command = command;
+    args.size = size;
+    args.data = data;
+    return ioctl(bus->fd, I2C_SMBUS, &args);
+}
+
+static inline void i2cDevClose(I2cBus *bus) {
+    close(bus->fd);
+    bus->fd = -1;
+}
+
+static const I2cBackend i2cDevBackend = {
+    "i2c-dev", i2cDevSetSlave, i2cDevFunctions, i2cDevWrite, i2cDevTransfer, i2cDevSmbus, i2cDevClose,
+};
+
+// Function to open an i2c-dev adapter
+static inline int i2cDevOpen(I2cBus *bus, const char *path) {
+    memset(bus, 0, sizeof(*bus));
+    bus->backend = &i2cDevBackend;
+    bus->fd = open(path, O_RDWR);
+    return bus->fd < 0 ? -1 : 0;
+}
+
+#endif // EEPROM_BUS_H
@@ -0,0 +1,638 @@
+#ifndef EEPROM_CATALOG_H
+#define EEPROM_CATALOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "eeprom_archive.h"
+#include "eeprom_layout.h"
+
+// Catalog of image files, indexed by serial, board serial, product ID and MAC.
+//
+// The catalog file holds the list of indexed images and, per key kind, an
+// array of (key, image) records sorted by key. It is memory-mapped for
+// lookups, which are a binary search, and duplicate checks, which are a
+// single pass over the sorted arrays. An update scans a directory, reads
+// the fields of images that are new or changed (by size and mtime), drops
+// images that are gone, and writes a new catalog that replaces the old one
+// by rename. An archive is indexed like a directory of its members, with
+// paths of the form <archive>/<name>.
+
+#define CATALOG_MAGIC 0x58494545 // "EEIX"
+#define CATALOG_VERSION 1
+
+// Keys are the field bytes, zero padded; MAC IDs are 6 bytes big-endian, so
+// byte order is numeric order
+#define CATALOG_KEY_LENGTH 20
+
+// Indexed fields, one sorted key array each
+#define CATALOG_KINDS(X) \
+    X(SERIAL, SERIAL_NUMBER) \
+    X(BOARD, PCB_SERIAL_NUMBER) \
+    X(PRODUCT, PRODUCT_ID) \
+    X(MAC, MAC_ID)
+
+enum {
+#define CATALOG_ENUM(kind, field) CATALOG_##kind,
+    CATALOG_KINDS(CATALOG_ENUM)
+#undef CATALOG_ENUM
+    CATALOG_KIND_COUNT
+};
+
+static const int catalogFields[CATALOG_KIND_COUNT] = {
+#define CATALOG_FIELD(kind, field) FIELD_##field,
+    CATALOG_KINDS(CATALOG_FIELD)
+#undef CATALOG_FIELD
+};
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    char layout[16];
+    uint32_t imageCount;
+    uint32_t keyCount[CATALOG_KIND_COUNT];
+    uint64_t imageOffset;                    // CatalogImage[imageCount]
+    uint64_t keyOffset[CATALOG_KIND_COUNT];  // CatalogKey[keyCount], sorted
+    uint64_t pathOffset;                     // NUL-terminated image paths
+    uint64_t pathLength;
+} CatalogHeader;
+
+typedef struct {
+    uint64_t path; // Offset into the path pool
+    uint64_t size;
+    int64_t mtime; // Nanoseconds
+} CatalogImage;
+
+typedef struct {
+    unsigned char key[CATALOG_KEY_LENGTH];
+    uint32_t image;
+} CatalogKey;
+
+// Mapped catalog
+typedef struct {
+    void *map;
+    size_t length;
+    const CatalogHeader *header;
+    const CatalogImage *images;
+    const CatalogKey *keys[CATALOG_KIND_COUNT];
+    const char *paths;
+} Catalog;
+
+// Catalog being built in memory
+typedef struct {
+    CatalogImage *images;
+    size_t imageCount, imageCapacity;
+    char *paths;
+    size_t pathLength, pathCapacity;
+    CatalogKey *keys[CATALOG_KIND_COUNT];
+    size_t keyCount[CATALOG_KIND_COUNT], keyCapacity[CATALOG_KIND_COUNT];
+} CatalogBuilder;
+
+// Function to map a catalog file, returns -1 if it is missing or not a catalog
+static inline int catalogOpen(Catalog *catalog, const char *path) {
+    struct stat info;
+    int fd = open(path, O_RDONLY);
+
+    memset(catalog, 0, sizeof(*catalog));
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(CatalogHeader)) {
+        close(fd);
+        return -1;
+    }
+    catalog->length = info.st_size;
+    catalog->map = mmap(NULL, catalog->length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (catalog->map == MAP_FAILED) {
+        catalog->map = NULL;
+        return -1;
+    }
+
+    const CatalogHeader *header = catalog->header = catalog->map;
+    int valid = header->magic == CATALOG_MAGIC && header->version == CATALOG_VERSION &&
+                header->imageOffset + (uint64_t)header->imageCount * sizeof(CatalogImage) <= catalog->length &&
+                header->pathOffset + header->pathLength <= catalog->length;
+    for (int kind = 0; kind < CATALOG_KIND_COUNT && valid; kind++) {
+        valid = header->keyOffset[kind] + (uint64_t)header->keyCount[kind] * sizeof(CatalogKey) <= catalog->length;
+        catalog->keys[kind] = (const CatalogKey *)((const char *)catalog->map + header->keyOffset[kind]);
+    }
+    if (!valid) {
+        fprintf(stderr, "%s is not a valid catalog\n", path);
+        munmap(catalog->map, catalog->length);
+        catalog->map = NULL;
+        return -1;
+    }
+    catalog->images = (const CatalogImage *)((const char *)catalog->map + header->imageOffset);
+    catalog->paths = (const char *)catalog->map + header->pathOffset;
+    return 0;
+}
+
+static inline void catalogClose(Catalog *catalog) {
+    if (catalog->map) {
+        munmap(catalog->map, catalog->length);
+        catalog->map = NULL;
+    }
+}
+
+static inline const char *catalogImagePath(const Catalog *catalog, uint32_t image) {
+    return catalog->paths + catalog->images[image].path;
+}
+
+// Function to find the first key of a kind that is not below the given
+// prefix of length bytes
+static inline size_t catalogLowerBound(const Catalog *catalog, int kind, const unsigned char *key, size_t length) {
+    const CatalogKey *keys = catalog->keys[kind];
+    size_t low = 0, high = catalog->header->keyCount[kind];
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (memcmp(keys[middle].key, key, length) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Function to turn a lookup value into key bytes. Text values may be a
+// prefix of the field. Returns the number of key bytes to match, or -1.
+static inline int catalogKey(int kind, const char *value, unsigned char *key) {
+    int field = catalogFields[kind];
+
+    memset(key, 0, CATALOG_KEY_LENGTH);
+    if (eepromFields[field].encoding == FIELD_MAC) {
+        uint64_t mac;
+        const char *end;
+        if (macParse(value, &mac, &end) != 6 || *end != '\0') {
+            return -1;
+        }
+        macPut((char *)key, mac);
+        return MAC_ID_LENGTH;
+    }
+    size_t length = strlen(value);
+    if (length == 0 || length > eepromFields[field].length) {
+        return -1;
+    }
+    memcpy(key, value, length);
+    return (int)length;
+}
+
+// Function to print every image whose field matches, returns the number of matches
+static inline unsigned long catalogLookup(const Catalog *catalog, int kind, const unsigned char *key, size_t length) {
+    const CatalogKey *keys = catalog->keys[kind];
+    unsigned long matches = 0;
+
+    for (size_t i = catalogLowerBound(catalog, kind, key, length);
+         i < catalog->header->keyCount[kind] && memcmp(keys[i].key, key, length) == 0; i++) {
+        printf("%s\n", catalogImagePath(catalog, keys[i].image));
+        matches++;
+    }
+    return matches;
+}
+
+// Function to format a key for a report
+static inline void catalogFormatKey(int kind, const unsigned char *key, char *out, size_t size) {
+    int field = catalogFields[kind];
+
+    if (eepromFields[field].encoding == FIELD_MAC) {
+        char mac[MAC_TEXT_LENGTH];
+        macFormat(macGet((const char *)key), mac);
+        snprintf(out, size, "%s", mac);
+    } else {
+        snprintf(out, size, "%.*s", (int)eepromFields[field].length, (const char *)key);
+    }
+}
+
+// Function to report every key held by more than one image. Returns the
+// number of duplicated keys.
+static inline unsigned long catalogDuplicates(const Catalog *catalog) {
+    unsigned long duplicates = 0;
+    char text[MAC_TEXT_LENGTH + CATALOG_KEY_LENGTH];
+
+    for (int kind = 0; kind < CATALOG_KIND_COUNT; kind++) {
+        const CatalogKey *keys = catalog->keys[kind];
+        size_t count = catalog->header->keyCount[kind];
+        // Product IDs are shared by design; only identities must be unique
+        if (kind == CATALOG_PRODUCT) {
+            continue;
+        }
+        for (size_t i = 0; i < count;) {
+            size_t end = i + 1;
+            while (end < count && memcmp(keys[end].key, keys[i].key, CATALOG_KEY_LENGTH) == 0) {
+                end++;
+            }
+            if (end - i > 1) {
+                catalogFormatKey(kind, keys[i].key, text, sizeof(text));
+                printf("Duplicate %s %s:", eepromFields[catalogFields[kind]].key, text);
+                for (size_t j = i; j < end; j++) {
+                    printf(" %s", catalogImagePath(catalog, keys[j].image));
+                }
+                printf("\n");
+                duplicates++;
+            }
+            i = end;
+        }
+    }
+    return duplicates;
+}
+
+// Function to grow a builder array so it can hold one more element
+static inline int catalogReserve(void **array, size_t *capacity, size_t count, size_t element, size_t more) {
+    if (count + more <= *capacity) {
+        return 0;
+    }
+    size_t grown = *capacity ? *capacity : 1024;
+    while (grown < count + more) {
+        grown *= 2;
+    }
+    void *resized = realloc(*array, grown * element);
+    if (!resized) {
+        return -1;
+    }
+    *array = resized;
+    *capacity = grown;
+    return 0;
+}
+
+// Function to add an image to the builder, returns its index or -1
+static inline long catalogAddImage(CatalogBuilder *builder, const char *path, uint64_t size, int64_t mtime) {
+    size_t length = strlen(path) + 1;
+
+    if (catalogReserve((void **)&builder->images, &builder->imageCapacity, builder->imageCount,
+                       sizeof(CatalogImage), 1) != 0 ||
+        catalogReserve((void **)&builder->paths, &builder->pathCapacity, builder->pathLength, 1, length) != 0) {
+        return -1;
+    }
+    builder->images[builder->imageCount] = (CatalogImage){builder->pathLength, size, mtime};
+    memcpy(builder->paths + builder->pathLength, path, length);
+    builder->pathLength += length;
+    return builder->imageCount++;
+}
+
+static inline int catalogAddKey(CatalogBuilder *builder, int kind, const unsigned char *key, uint32_t image) {
+    if (catalogReserve((void **)&builder->keys[kind], &builder->keyCapacity[kind], builder->keyCount[kind],
+                       sizeof(CatalogKey), 1) != 0) {
+        return -1;
+    }
+    CatalogKey *entry = &builder->keys[kind][builder->keyCount[kind]++];
+    memcpy(entry->key, key, CATALOG_KEY_LENGTH);
+    entry->image = image;
+    return 0;
+}
+
+// Function to check whether field bytes were never programmed
+static inline int catalogBlank(const char *data, size_t length) {
+    unsigned char first = data[0];
+
+    if (first != 0x00 && first != 0xFF) {
+        return 0;
+    }
+    for (size_t i = 1; i < length; i++) {
+        if ((unsigned char)data[i] != first) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Function to add the keys of one image; blank fields and MAC slots are skipped
+static inline int catalogAddKeys(CatalogBuilder *builder, const EepromLayout *layout, const char *image,
+                                 uint32_t index) {
+    unsigned char key[CATALOG_KEY_LENGTH];
+
+    for (int kind = 0; kind < CATALOG_KIND_COUNT; kind++) {
+        int field = catalogFields[kind];
+        const char *data = image + layout->offset[field];
+        if (eepromFields[field].encoding == FIELD_MAC) {
+            for (int slot = 0; slot < MAC_ID_COUNT; slot++) {
+                const char *mac = data + slot * MAC_ID_LENGTH;
+                if (catalogBlank(mac, MAC_ID_LENGTH)) {
+                    continue;
+                }
+                memset(key, 0, sizeof(key));
+                memcpy(key, mac, MAC_ID_LENGTH);
+                if (catalogAddKey(builder, kind, key, index) != 0) {
+                    return -1;
+                }
+            }
+            continue;
+        }
+        if (catalogBlank(data, eepromFields[field].length)) {
+            continue;
+        }
+        memset(key, 0, sizeof(key));
+        memcpy(key, data, eepromFields[field].length);
+        if (catalogAddKey(builder, kind, key, index) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static inline int catalogCompareKeys(const void *a, const void *b) {
+    const CatalogKey *x = a, *y = b;
+    int order = memcmp(x->key, y->key, CATALOG_KEY_LENGTH);
+    return order ? order : (x->image > y->image) - (x->image < y->image);
+}
+
+// Function to write all of a buffer
+static inline int catalogWriteAll(int fd, const void *data, size_t length) {
+    const char *bytes = data;
+
+    while (length > 0) {
+        ssize_t put = write(fd, bytes, length);
+        if (put < 0) {
+            return -1;
+        }
+        bytes += put;
+        length -= put;
+    }
+    return 0;
+}
+
+// Function to sort the builder and store it as the catalog at path
+static inline int catalogWrite(CatalogBuilder *builder, const char *path, const EepromLayout *layout) {
+    CatalogHeader header;
+    char temporary[PATH_MAX];
+    uint64_t offset = sizeof(header);
+
+    memset(&header, 0, sizeof(header));
+    header.magic = CATALOG_MAGIC;
+    header.version = CATALOG_VERSION;
+    snprintf(header.layout, sizeof(header.layout), "%s", layout->name);
+    header.imageCount = builder->imageCount;
+    header.imageOffset = offset;
+    offset += builder->imageCount * sizeof(CatalogImage);
+    for (int kind = 0; kind < CATALOG_KIND_COUNT; kind++) {
+        if (builder->keyCount[kind] > 0) {
+            qsort(builder->keys[kind], builder->keyCount[kind], sizeof(CatalogKey), catalogCompareKeys);
+        }
+        header.keyCount[kind] = builder->keyCount[kind];
+        header.keyOffset[kind] = offset;
+        offset += builder->keyCount[kind] * sizeof(CatalogKey);
+    }
+    header.pathOffset = offset;
+    header.pathLength = builder->pathLength;
+
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("Failed to write catalog");
+        return -1;
+    }
+    int ok = catalogWriteAll(fd, &header, sizeof(header)) == 0 &&
+             catalogWriteAll(fd, builder->images, builder->imageCount * sizeof(CatalogImage)) == 0;
+    for (int kind = 0; kind < CATALOG_KIND_COUNT && ok; kind++) {
+        ok = catalogWriteAll(fd, builder->keys[kind], builder->keyCount[kind] * sizeof(CatalogKey)) == 0;
+    }
+    ok = ok && catalogWriteAll(fd, builder->paths, builder->pathLength) == 0 && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(temporary, path) != 0) {
+        perror("Failed to write catalog");
+        unlink(temporary);
+        return -1;
+    }
+    return 0;
+}
+
+static inline void catalogBuilderFree(CatalogBuilder *builder) {
+    free(builder->images);
+    free(builder->paths);
+    for (int kind = 0; kind < CATALOG_KIND_COUNT; kind++) {
+        free(builder->keys[kind]);
+    }
+}
+
+// Function to hash an image path for the update table
+static inline uint64_t catalogHash(const char *text) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+
+    while (*text) {
+        hash = (hash ^ (unsigned char)*text++) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+// State of an indexed image during an update
+#define CATALOG_GONE 0
+#define CATALOG_KEPT 1
+#define CATALOG_CHANGED 2
+
+// Function to index every image file of a directory, or every member of an
+// archive, into the catalog at path. Images indexed before keep their keys
+// unless their size or mtime changed; images under the directory that are
+// gone are dropped.
+static inline int catalogUpdate(const char *path, const char *dirPath, const EepromLayout *layout) {
+    Catalog old;
+    CatalogBuilder builder;
+    char imagePath[PATH_MAX];
+    char *image = malloc(layout->end);
+    unsigned long added = 0, changed = 0, kept = 0, removed = 0, skipped = 0;
+
+    memset(&builder, 0, sizeof(builder));
+    // Paths are stored as <dir>/<name>, without a doubled '/'
+    size_t prefixLength = strlen(dirPath);
+    while (prefixLength > 1 && dirPath[prefixLength - 1] == '/') {
+        prefixLength--;
+    }
+    int hasOld = catalogOpen(&old, path) == 0;
+    if (hasOld && strncmp(old.header->layout, layout->name, sizeof(old.header->layout)) != 0) {
+        fprintf(stderr, "Catalog %s uses the %.16s layout, not %s\n", path, old.header->layout, layout->name);
+        catalogClose(&old);
+        free(image);
+        return -1;
+    }
+    size_t oldCount = hasOld ? old.header->imageCount : 0;
+
+    // Open-addressed table of old image paths, and what the scan found for each
+    // (CATALOG_GONE until seen)
+    size_t slots = 1;
+    while (slots < oldCount * 2 + 2) {
+        slots *= 2;
+    }
+    long *table = malloc(slots * sizeof(long));
+    unsigned char *current = calloc(oldCount + 1, 1);
+    if (!image || !table || !current) {
+        perror("Failed to update catalog");
+        free(image);
+        free(table);
+        free(current);
+        catalogClose(&old);
+        return -1;
+    }
+    memset(table, 0xFF, slots * sizeof(long));
+    for (size_t i = 0; i < oldCount; i++) {
+        size_t slot = catalogHash(catalogImagePath(&old, i)) & (slots - 1);
+        while (table[slot] >= 0) {
+            slot = (slot + 1) & (slots - 1);
+        }
+        table[slot] = i;
+    }
+
+    Archive archive;
+    int isArchive = archiveOpen(&archive, dirPath) == 0;
+    char *member = isArchive ? malloc(archive.header->imageSize) : NULL;
+    DIR *dir = isArchive ? NULL : opendir(dirPath);
+    if (isArchive ? !member : !dir) {
+        perror(dirPath);
+        archiveClose(&archive);
+        free(member);
+        free(image);
+        free(table);
+        free(current);
+        catalogClose(&old);
+        return -1;
+    }
+
+    // New and changed images are read now; their keys go in after the kept ones
+    int status = 0;
+    struct dirent *entry;
+    CatalogBuilder fresh;
+    memset(&fresh, 0, sizeof(fresh));
+    for (size_t memberIndex = 0; status == 0; memberIndex++) {
+        struct stat info;
+        const char *name;
+        int64_t mtime;
+        ArchiveRecord record;
+        if (isArchive) {
+            // Members carry the mtime of the file they were appended from
+            if (memberIndex == archive.header->imageCount) {
+                break;
+            }
+            name = archiveName(&archive, memberIndex);
+            info.st_size = archive.header->imageSize;
+            mtime = archiveRecord(&archive, memberIndex, &record) ? record.mtime : 0;
+        } else {
+            if ((entry = readdir(dir)) == NULL) {
+                break;
+            }
+            if (entry->d_name[0] == '.' || fstatat(dirfd(dir), entry->d_name, &info, 0) != 0 || !S_ISREG(info.st_mode)) {
+                continue;
+            }
+            name = entry->d_name;
+            mtime = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+        }
+        snprintf(imagePath, sizeof(imagePath), "%.*s/%s", (int)prefixLength, dirPath, name);
+
+        long known = -1;
+        size_t slot = catalogHash(imagePath) & (slots - 1);
+        while (oldCount && table[slot] >= 0) {
+            if (strcmp(catalogImagePath(&old, table[slot]), imagePath) == 0) {
+                known = table[slot];
+                break;
+            }
+            slot = (slot + 1) & (slots - 1);
+        }
+        if (known >= 0 && old.images[known].size == (uint64_t)info.st_size && old.images[known].mtime == mtime) {
+            current[known] = CATALOG_KEPT;
+            kept++;
+            continue;
+        }
+        if (known >= 0) {
+            current[known] = CATALOG_CHANGED;
+        }
+
+        if (isArchive) {
+            if (info.st_size < (off_t)layout->end || archiveExtract(&archive, memberIndex, member) != 0) {
+                skipped++;
+                continue;
+            }
+            memcpy(image, member, layout->end);
+        } else {
+            int fd = openat(dirfd(dir), name, O_RDONLY);
+            if (fd < 0 || info.st_size < (off_t)layout->end || pread(fd, image, layout->end, 0) != (ssize_t)layout->end) {
+                if (fd >= 0) {
+                    close(fd);
+                }
+                // Too short to hold the layout; a changed image that shrank is dropped
+                skipped++;
+                continue;
+            }
+            close(fd);
+        }
+        long index = catalogAddImage(&fresh, imagePath, info.st_size, mtime);
+        if (index < 0 || catalogAddKeys(&fresh, layout, image, index) != 0) {
+            perror("Failed to update catalog");
+            status = -1;
+        }
+        if (known >= 0) {
+            changed++;
+        } else {
+            added++;
+        }
+    }
+    if (dir) {
+        closedir(dir);
+    }
+    archiveClose(&archive);
+    free(member);
+
+    // Kept images come first: images of other directories, and current ones of this one
+    long *remap = malloc((oldCount + 1) * sizeof(long));
+    for (size_t i = 0; i < oldCount && status == 0 && remap; i++) {
+        const char *oldPath = catalogImagePath(&old, i);
+        int underDir = strncmp(oldPath, dirPath, prefixLength) == 0 && oldPath[prefixLength] == '/' &&
+                       strchr(oldPath + prefixLength + 1, '/') == NULL;
+        remap[i] = -1;
+        if (underDir && current[i] != CATALOG_KEPT) {
+            removed += current[i] == CATALOG_GONE;
+            continue;
+        }
+        remap[i] = catalogAddImage(&builder, oldPath, old.images[i].size, old.images[i].mtime);
+        if (remap[i] < 0) {
+            status = -1;
+        }
+    }
+    for (int kind = 0; kind < CATALOG_KIND_COUNT && status == 0 && remap; kind++) {
+        for (size_t i = 0; hasOld && i < old.header->keyCount[kind] && status == 0; i++) {
+            const CatalogKey *key = &old.keys[kind][i];
+            if (remap[key->image] >= 0) {
+                status = catalogAddKey(&builder, kind, key->key, remap[key->image]);
+            }
+        }
+    }
+    size_t base = builder.imageCount;
+    for (size_t i = 0; i < fresh.imageCount && status == 0; i++) {
+        if (catalogAddImage(&builder, fresh.paths + fresh.images[i].path, fresh.images[i].size,
+                            fresh.images[i].mtime) < 0) {
+            status = -1;
+        }
+    }
+    for (int kind = 0; kind < CATALOG_KIND_COUNT && status == 0; kind++) {
+        for (size_t i = 0; i < fresh.keyCount[kind] && status == 0; i++) {
+            status = catalogAddKey(&builder, kind, fresh.keys[kind][i].key, base + fresh.keys[kind][i].image);
+        }
+    }
+    if (!remap) {
+        perror("Failed to update catalog");
+        status = -1;
+    }
+
+    catalogClose(&old);
+    if (status == 0) {
+        status = catalogWrite(&builder, path, layout);
+    }
+    if (status == 0) {
+        printf("Catalog: %zu images, %lu added, %lu changed, %lu removed, %lu unchanged, %lu skipped\n",
+               builder.imageCount, added, changed, removed, kept, skipped);
+    }
+    catalogBuilderFree(&fresh);
+    catalogBuilderFree(&builder);
+    free(remap);
+    free(table);
+    free(current);
+    free(image);
+    return status;
+}
+
+#endif // EEPROM_CATALOG_H
@@ -0,0 +1,191 @@
+#ifndef EEPROM_CRC32C_H
+#define EEPROM_CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// CRC32C (Castagnoli) used to protect the parameter block.
+//
+// The SSE4.2 crc32 instruction is used when the CPU has it, otherwise a
+// slice-by-8 table kernel. crc32cPatch updates a stored CRC after a field
+// changes without rehashing the block: the CRC is linear, so the change
+// only depends on the XOR of old and new bytes shifted to their position.
+
+// Reflected Castagnoli polynomial
+#define CRC32C_POLY 0x82F63B78u
+
+static uint32_t crc32cTable[8][256];
+static uint32_t crc32cPowers[32]; // x^(2^k) mod P
+static int crc32cHardwareAvailable;
+static int crc32cReady;
+
+// Function to multiply two polynomials modulo P (reflected bit order)
+static inline uint32_t crc32cMultiply(uint32_t a, uint32_t b) {
+    uint32_t m = 1u << 31, product = 0;
+
+    for (;;) {
+        if (a & m) {
+            product ^= b;
+            if ((a & (m - 1)) == 0) {
+                break;
+            }
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return product;
+}
+
+// Function to build the tables, call once before starting threads
+static inline void crc32cInit(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        crc32cTable[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int slice = 1; slice < 8; slice++) {
+            uint32_t previous = crc32cTable[slice - 1][i];
+            crc32cTable[slice][i] = (previous >> 8) ^ crc32cTable[0][previous & 0xFF];
+        }
+    }
+
+    uint32_t power = 1u << 30; // x^1
+    crc32cPowers[0] = power;
+    for (int k = 1; k < 32; k++) {
+        power = crc32cPowers[k] = crc32cMultiply(power, power);
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    crc32cHardwareAvailable = __builtin_cpu_supports("sse4.2");
+#endif
+    crc32cReady = 1;
+}
+
+// Function to run the raw CRC register over data, one byte at a time
+static inline uint32_t crc32cBytewise(uint32_t crc, const unsigned char *data, size_t length) {
+    while (length--) {
+        crc = (crc >> 8) ^ crc32cTable[0][(crc ^ *data++) & 0xFF];
+    }
+    return crc;
+}
+
+// Function to run the raw CRC register over data, eight bytes at a time
+static inline uint32_t crc32cSliceBy8(uint32_t crc, const void *buffer, size_t length) {
+    const unsigned char *data = buffer;
+
+    while (length && ((uintptr_t)data & 7)) {
+        crc = (crc >> 8) ^ crc32cTable[0][(crc ^ *data++) & 0xFF];
+        length--;
+    }
+    while (length >= 8) {
+        uint32_t low, high;
+        memcpy(&low, data, 4);
+        memcpy(&high, data + 4, 4);
+        low ^= crc;
+        crc = crc32cTable[7][low & 0xFF] ^ crc32cTable[6][(low >> 8) & 0xFF] ^
+              crc32cTable[5][(low >> 16) & 0xFF] ^ crc32cTable[4][low >> 24] ^
+              crc32cTable[3][high & 0xFF] ^ crc32cTable[2][(high >> 8) & 0xFF] ^
+              crc32cTable[1][(high >> 16) & 0xFF] ^ crc32cTable[0][high >> 24];
+        data += 8;
+        length -= 8;
+    }
+    return crc32cBytewise(crc, data, length);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Function to run the raw CRC register over data with the SSE4.2 instruction
+__attribute__((target("sse4.2")))
+static inline uint32_t crc32cHardware(uint32_t crc, const void *buffer, size_t length) {
+    const unsigned char *data = buffer;
+
+    while (length && ((uintptr_t)data & 7)) {
+        crc = __builtin_ia32_crc32qi(crc, *data++);
+        length--;
+    }
+#if defined(__x86_64__)
+    uint64_t crc64 = crc;
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        crc64 = __builtin_ia32_crc32di(crc64, word);
+        data += 8;
+        length -= 8;
+    }
+    crc = (uint32_t)crc64;
+#endif
+    while (length >= 4) {
+        uint32_t word;
+        memcpy(&word, data, 4);
+        crc = __builtin_ia32_crc32si(crc, word);
+        data += 4;
+        length -= 4;
+    }
+    while (length--) {
+        crc = __builtin_ia32_crc32qi(crc, *data++);
+    }
+    return crc;
+}
+#endif
+
+// Function to run the raw CRC register with the fastest available kernel
+static inline uint32_t crc32cRaw(uint32_t crc, const void *data, size_t length) {
+    if (!crc32cReady) {
+        crc32cInit();
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    if (crc32cHardwareAvailable) {
+        return crc32cHardware(crc, data, length);
+    }
+#endif
+    return crc32cSliceBy8(crc, data, length);
+}
+
+// Function to compute the standard CRC32C of a buffer
+static inline uint32_t crc32c(const void *data, size_t length) {
+    return ~crc32cRaw(0xFFFFFFFFu, data, length);
+}
+
+// Function to compute x^(8 * bytes) mod P, the effect of appending zero bytes
+static inline uint32_t crc32cZeroShift(size_t bytes) {
+    if (!crc32cReady) {
+        crc32cInit();
+    }
+
+    uint32_t result = 1u << 31; // x^0
+    unsigned int k = 3;         // 8 bits per byte
+    while (bytes) {
+        if (bytes & 1) {
+            result = crc32cMultiply(crc32cPowers[k & 31], result);
+        }
+        bytes >>= 1;
+        k++;
+    }
+    return result;
+}
+
+// Function to update the CRC of a block after bytes at position changed
+// from oldData to newData, without reading the rest of the block
+static inline uint32_t crc32cPatch(uint32_t crc, size_t blockLength, size_t position,
+                                   const void *oldData, const void *newData, size_t length) {
+    const unsigned char *oldBytes = oldData;
+    const unsigned char *newBytes = newData;
+    unsigned char delta[256];
+    uint32_t deltaCrc = 0;
+
+    for (size_t done = 0; done < length; done += sizeof(delta)) {
+        size_t chunk = length - done < sizeof(delta) ? length - done : sizeof(delta);
+        for (size_t i = 0; i < chunk; i++) {
+            delta[i] = oldBytes[done + i] ^ newBytes[done + i];
+        }
+        deltaCrc = crc32cRaw(deltaCrc, delta, chunk);
+    }
+
+    return crc ^ crc32cMultiply(crc32cZeroShift(blockLength - position - length), deltaCrc);
+}
+
+#endif // EEPROM_CRC32C_H
@@ -0,0 +1,166 @@
+#ifndef EEPROM_DIFF_H
+#define EEPROM_DIFF_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "eeprom_layout.h"
+
+// Image comparison.
+//
+// Equal spans are skipped 16 bytes at a time with SSE2 (8 bytes at a time
+// elsewhere), so comparing an image against its golden template costs
+// little more than touching its pages. Differing runs are then mapped to
+// the fields of the layout; bytes outside every field (the record log or
+// unused space) are reported as "other".
+
+// Largest number of differing runs outside the fields reported per image
+#define DIFF_MAX_RANGES 64
+
+// Run of bytes [begin, end)
+typedef struct {
+    size_t begin;
+    size_t end;
+} DiffRange;
+
+// Per-image result
+typedef struct {
+    unsigned int fieldMask;        // Bit per field with at least one differing byte
+    size_t fieldBytes[FIELD_COUNT]; // Differing bytes inside each field
+    size_t otherBytes;             // Differing bytes outside every field
+    size_t bytes;                  // All differing bytes
+    int otherCount;
+    int truncated;                 // More runs outside the fields than DIFF_MAX_RANGES
+    DiffRange other[DIFF_MAX_RANGES];
+} DiffResult;
+
+// Function to find the first differing byte at or after start, size if none
+static inline size_t eepromDiffNext(const char *a, const char *b, size_t start, size_t size) {
+    size_t i = start;
+
+#if defined(__SSE2__)
+    while (i + 16 <= size) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+        unsigned int equal = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y));
+        if (equal != 0xFFFF) {
+            return i + __builtin_ctz(~equal & 0xFFFF);
+        }
+        i += 16;
+    }
+#endif
+    while (i + 8 <= size) {
+        uint64_t x, y;
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        if (x != y) {
+            break;
+        }
+        i += 8;
+    }
+    while (i < size && a[i] == b[i]) {
+        i++;
+    }
+    return i;
+}
+
+// Function to find the end of a differing run that starts at start
+static inline size_t eepromDiffRunEnd(const char *a, const char *b, size_t start, size_t size) {
+    size_t i = start;
+
+    while (i < size && a[i] != b[i]) {
+        i++;
+    }
+    return i;
+}
+
+// Function to charge a differing run to the fields it overlaps. The parts
+// outside every field are kept as "other" runs.
+static inline void eepromDiffClassify(const EepromLayout *layout, DiffResult *result, size_t begin, size_t end) {
+    size_t position = begin;
+
+    while (position < end) {
+        size_t next = end;
+        int inside = -1;
+        for (int id = 0; id < FIELD_COUNT; id++) {
+            size_t fieldBegin = layout->offset[id];
+            size_t fieldEnd = fieldBegin + eepromFields[id].length;
+            if (position >= fieldBegin && position < fieldEnd) {
+                inside = id;
+                next = fieldEnd < end ? fieldEnd : end;
+                break;
+            }
+            if (fieldBegin > position && fieldBegin < next) {
+                next = fieldBegin;
+            }
+        }
+
+        if (inside >= 0) {
+            result->fieldMask |= 1u << inside;
+            result->fieldBytes[inside] += next - position;
+        } else {
+            result->otherBytes += next - position;
+            if (result->otherCount < DIFF_MAX_RANGES) {
+                result->other[result->otherCount++] = (DiffRange){position, next};
+            } else {
+                result->truncated = 1;
+            }
+        }
+        position = next;
+    }
+}
+
+// Function to compare an image with a reference. Bytes past the end of
+// the shorter one count as differing. Returns the number of differing bytes.
+static inline size_t eepromDiff(const EepromLayout *layout, const char *image, size_t imageSize,
+                                const char *reference, size_t referenceSize, DiffResult *result) {
+    size_t common = imageSize < referenceSize ? imageSize : referenceSize;
+    size_t longer = imageSize > referenceSize ? imageSize : referenceSize;
+    size_t position = 0;
+
+    memset(result, 0, sizeof(*result));
+    for (;;) {
+        size_t begin = eepromDiffNext(image, reference, position, common);
+        size_t end = begin < common ? eepromDiffRunEnd(image, reference, begin, common) : longer;
+        if (begin == common && common == longer) {
+            break;
+        }
+        eepromDiffClassify(layout, result, begin, end);
+        result->bytes += end - begin;
+        if (end == longer) {
+            break;
+        }
+        position = end;
+    }
+    return result->bytes;
+}
+
+// Function to format a field value for a diff report. Text is quoted with
+// bytes that are not printable escaped, stamps are shown as hex.
+static inline void eepromDiffFormat(int id, const char *data, char *out, size_t size) {
+    const EepromFieldInfo *field = &eepromFields[id];
+    size_t used = 0;
+
+    if (field->encoding == FIELD_MAC) {
+        eepromFieldFormat(id, data, out, size);
+        return;
+    }
+    if (field->encoding == FIELD_STAMP) {
+        snprintf(out, size, "0x%08X", eepromGetU32(data));
+        return;
+    }
+    used = snprintf(out, size, "'");
+    for (unsigned int i = 0; i < field->length && used + 6 < size; i++) {
+        unsigned char c = data[i];
+        used += snprintf(out + used, size - used, isprint(c) && c != '\\' && c != '\'' ? "%c" : "\\x%02X", c);
+    }
+    snprintf(out + used, size - used, "'");
+}
+
+#endif // EEPROM_DIFF_H
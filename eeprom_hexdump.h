@@ -0,0 +1,160 @@
+#ifndef EEPROM_HEXDUMP_H
+#define EEPROM_HEXDUMP_H
+
+#include <stdio.h>
+#include <string.h>
+
+// Buffered hex dump formatter.
+//
+// Whole rows are formatted into one output buffer from lookup tables and
+// the buffer is handed to stdio in large blocks, instead of one printf or
+// putchar call per byte.
+
+// Size of the output block handed to fwrite
+#define HEXDUMP_BLOCK_SIZE 65536
+
+// Default and maximum number of bytes shown per row
+#define HEXDUMP_DEFAULT_WIDTH 16
+#define HEXDUMP_MAX_WIDTH 64
+
+// Longest possible row: address, hex column, gutter, ASCII column, newline
+#define HEXDUMP_MAX_ROW (2 + 16 + 2 + HEXDUMP_MAX_WIDTH * 3 + 2 + HEXDUMP_MAX_WIDTH + 1)
+
+typedef struct {
+    size_t start;   // First byte to dump
+    size_t length;  // Number of bytes to dump, 0 means up to the end
+    int width;      // Bytes per row
+    int squeeze;    // Collapse repeated rows into a single '*' line
+    int machine;    // Machine-readable "OFFSET HEX" rows without header or ASCII
+} HexDumpOptions;
+
+#define HEXDUMP_DEFAULT_OPTIONS {0, 0, HEXDUMP_DEFAULT_WIDTH, 0, 0}
+
+// "XX " for every byte value and the printable form of every byte value
+static char hexDumpHexTable[256][3];
+static char hexDumpAsciiTable[256];
+static int hexDumpTablesReady;
+
+static inline void hexDumpInitTables(void) {
+    static const char digits[] = "0123456789ABCDEF";
+
+    for (int i = 0; i < 256; i++) {
+        hexDumpHexTable[i][0] = digits[i >> 4];
+        hexDumpHexTable[i][1] = digits[i & 0x0F];
+        hexDumpHexTable[i][2] = ' ';
+        hexDumpAsciiTable[i] = (i >= 32 && i <= 126) ? (char)i : '.';
+    }
+    hexDumpTablesReady = 1;
+}
+
+// Function to format an address with a fixed number of hex digits
+static inline char *hexDumpAddress(char *out, size_t address, int digits) {
+    static const char hex[] = "0123456789ABCDEF";
+
+    for (int i = digits - 1; i >= 0; i--) {
+        out[i] = hex[address & 0x0F];
+        address >>= 4;
+    }
+    return out + digits;
+}
+
+// Function to format one row into the output buffer, returns the new end
+static inline char *hexDumpRow(char *out, const unsigned char *row, int count, size_t address,
+                               int digits, const HexDumpOptions *options) {
+    if (options->machine) {
+        out = hexDumpAddress(out, address, digits);
+        *out++ = ' ';
+        for (int i = 0; i < count; i++) {
+            memcpy(out, hexDumpHexTable[row[i]], 2);
+            out += 2;
+        }
+        *out++ = '\n';
+        return out;
+    }
+
+    *out++ = '0';
+    *out++ = 'x';
+    out = hexDumpAddress(out, address, digits);
+    *out++ = ':';
+    *out++ = ' ';
+    for (int i = 0; i < count; i++) {
+        memcpy(out, hexDumpHexTable[row[i]], 3);
+        out += 3;
+    }
+    // Pad a short last row so the ASCII gutter stays aligned
+    memset(out, ' ', (options->width - count) * 3 + 2);
+    out += (options->width - count) * 3 + 2;
+    for (int i = 0; i < count; i++) {
+        *out++ = hexDumpAsciiTable[row[i]];
+    }
+    *out++ = '\n';
+    return out;
+}
+
+// Function to dump a range of data to a stream
+static inline int hexDumpToStream(FILE *stream, const char *data, size_t size, const HexDumpOptions *options) {
+    static char block[HEXDUMP_BLOCK_SIZE];
+    char *out = block;
+    size_t start = options->start;
+    size_t end = options->length ? start + options->length : size;
+    int width = options->width;
+    int digits = 4;
+    int squeezing = 0;
+
+    if (!hexDumpTablesReady) {
+        hexDumpInitTables();
+    }
+    if (end > size) {
+        end = size;
+    }
+    if (start >= end) {
+        return 0;
+    }
+    while (digits < 16 && (end - 1) >> (digits * 4) != 0) {
+        digits++;
+    }
+
+    if (!options->machine) {
+        fputs("EEPROM Hex Dump:\n", stream);
+    }
+
+    for (size_t address = start; address < end; address += width) {
+        const unsigned char *row = (const unsigned char *)data + address;
+        int count = end - address < (size_t)width ? (int)(end - address) : width;
+
+        // Rows equal to the previous one collapse into a single '*' line,
+        // except the last row which always shows where the data ends
+        if (options->squeeze && address > start && count == width && address + width < end &&
+            memcmp(row, row - width, width) == 0) {
+            if (!squeezing) {
+                *out++ = '*';
+                *out++ = '\n';
+                squeezing = 1;
+            }
+        } else {
+            squeezing = 0;
+            out = hexDumpRow(out, row, count, address, digits, options);
+        }
+
+        if (out - block > HEXDUMP_BLOCK_SIZE - HEXDUMP_MAX_ROW) {
+            if (fwrite(block, 1, out - block, stream) != (size_t)(out - block)) {
+                return -1;
+            }
+            out = block;
+        }
+    }
+
+    if (out > block && fwrite(block, 1, out - block, stream) != (size_t)(out - block)) {
+        return -1;
+    }
+    return fflush(stream);
+}
+
+// Function to print a hex dump of EEPROM data with addresses and characters
+static inline void printHexDump(const char *data, int length) {
+    HexDumpOptions options = HEXDUMP_DEFAULT_OPTIONS;
+
+    hexDumpToStream(stdout, data, length, &options);
+}
+
+#endif // EEPROM_HEXDUMP_H
@@ -4,253 +4,2068 @@
 #include <getopt.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <linux/i2c.h>
 #include <linux/i2c-dev.h>
-#include <sys/ioctl.h>
-
-// Define your data types here
-typedef char RJS8T;
-typedef unsigned char RJU8T;
-typedef signed short RJS16T;
-typedef unsigned short RJU16T;
-typedef signed int RJS32T;
-typedef unsigned int RJU32T;
-
-// Define lengths for your parameters
-#define SERIAL_NUMBER_LENGTH 18
-#define PCB_SERIAL_NUMBER_LEN 18
-#define PRODUCT_ID_LEN 12
-#define MAC_ID_LEN 6
-#define MAC_ID_COUNT 3
-
-// Define fixed offsets for each parameter
-#define SERIAL_NUMBER_OFFSET 100
-#define PCB_SERIAL_NUMBER_OFFSET (SERIAL_NUMBER_OFFSET + SERIAL_NUMBER_LENGTH)
-#define PRODUCT_ID_OFFSET (PCB_SERIAL_NUMBER_OFFSET + PCB_SERIAL_NUMBER_LEN)
-#define MAC_ID_OFFSET (PRODUCT_ID_OFFSET + PRODUCT_ID_LEN)
-
-// I2C Configuration
+
+#include "eeprom_bus.h"
+#include "eeprom_hexdump.h"
+#include "eeprom_layout.h"
+#include "eeprom_log.h"
+#include "eeprom_metrics.h"
+#include "eeprom_sim.h"
+
+// Board layout, ODSC 5G unless chosen at build time or with --layout
+#ifndef EEPROM_LAYOUT
+#define EEPROM_LAYOUT ODSC5G
+#endif
+
+// Generation stamp, bumped on every run that writes the device
+#define GENERATION_OFFSET (eepromLayout->offset[FIELD_GENERATION])
+#define GENERATION_LEN FIELD_LENGTH_GENERATION
+
+// Parameter region, read in one burst on first access
+#define PARAMETER_REGION_OFFSET eepromLayoutBegin(eepromLayout)
+#define PARAMETER_REGION_END (eepromLayout->end)
+
+// Size of the parameter image mirrored in memory
+#define EEPROM_SIZE 1024
+
+_Static_assert(EEPROM_SIZE >= EEPROM_LAYOUT_LIMIT, "The shadow image must hold every layout");
+
+// Persisted shadow file identification
+#define SHADOW_MAGIC 0x32534545 // "EES2"
+
+// I2C Configuration, overridden with --bus and --address
 #define EEPROM_I2C_ADDRESS 0x50
 #define I2C_BUS "/dev/i2c-1"
 
-// Function to print a hex dump of EEPROM data with addresses and characters
-void printHexDump(const char *data, int length) {
-    printf("EEPROM Hex Dump:\n");
-
-    for (int i = 0; i < length; i++) {
-        if (i % 16 == 0) {
-            if (i > 0) {
-                printf("  ");
-                for (int j = i - 16; j < i; j++) {
-                    if (j >= 0) {
-                        char c = data[j];
-                        if (c >= 32 && c <= 126) {
-                            putchar(c);
-                        } else {
-                            putchar('.');
-                        }
+// Maximum time to wait for the internal write cycle (tWR) to finish
+#define EEPROM_WRITE_TIMEOUT_MS 25
+
+// Largest page size supported by the write engine
+#define EEPROM_MAX_PAGE_SIZE 256
+
+// Bytes moved per step by --dump and --restore, whatever the part size
+#define EEPROM_STREAM_BUFFER 4096
+
+// Supported EEPROM parts. Address bits beyond the address bytes select a
+// block through the low bits of the slave address: 24C04-24C16 take 1-3
+// of them with 1-byte addressing, 24M01/24M02 take 1-2 with 2-byte addressing.
+typedef struct {
+    const char *name;
+    unsigned int size;
+    unsigned int pageSize;
+    unsigned int addressBytes;
+} EepromPart;
+
+static const EepromPart eepromParts[] = {
+    {"24C01", 128, 8, 1},
+    {"24C02", 256, 8, 1},
+    {"24C04", 512, 16, 1},
+    {"24C08", 1024, 16, 1},
+    {"24C16", 2048, 16, 1},
+    {"24C32", 4096, 32, 2},
+    {"24C64", 8192, 32, 2},
+    {"24C128", 16384, 64, 2},
+    {"24C256", 32768, 64, 2},
+    {"24C512", 65536, 128, 2},
+    {"24M01", 131072, 256, 2},
+    {"24M02", 262144, 256, 2},
+};
+
+#define EEPROM_PART_COUNT (sizeof(eepromParts) / sizeof(eepromParts[0]))
+#define EEPROM_DEFAULT_PART "24C32"
+
+// Selected board layout
+static const EepromLayout *eepromLayout = EEPROM_DEFAULT_LAYOUT;
+
+// Page size of the selected part
+static unsigned int eepromPageSize = 32;
+
+// Addressing and size of the selected part
+static unsigned int eepromAddressBytes = 2;
+static unsigned int eepromPartSize = 4096;
+
+// Bytes of the device mirrored by the shadow: the part, up to EEPROM_SIZE
+static unsigned int eepromImageSize = EEPROM_SIZE;
+
+// Largest read transfer accepted by i2c-dev
+#define I2C_DEV_MAX_TRANSFER 8192
+
+// Transfer strategy chosen from the adapter capabilities
+#define XFER_I2C 0   // Combined write-read with I2C_RDWR
+#define XFER_SMBUS 1 // SMBus I2C-block writes and byte reads
+#define XFER_SMBUS_BLOCK 2 // SMBus I2C-block writes and reads, 1-byte addressing only
+
+// Adapter and device state is per thread, so fleet mode can run one
+// worker per bus with the same functions as the single-device path
+static __thread int transferMode = XFER_I2C;
+static unsigned int maxTransferSize = I2C_DEV_MAX_TRANSFER;
+static __thread unsigned short eepromAddress = EEPROM_I2C_ADDRESS;
+static __thread unsigned short selectedSlave = EEPROM_I2C_ADDRESS; // Current I2C_SLAVE address of the fd
+
+// Read statistics, reported at exit
+typedef struct {
+    unsigned long bytes;
+    unsigned long transactions;
+} EepromReadStats;
+
+static __thread EepromReadStats readStats;
+
+// Largest number of queued writes a deferred shadow can hold
+#define SHADOW_MAX_PENDING 256
+
+// Range of the shadow waiting to be written to the device
+typedef struct {
+    unsigned int offset;
+    unsigned int length;
+} ShadowRange;
+
+// Shadow copy of the device contents, filled on first access
+typedef struct {
+    char data[EEPROM_SIZE];
+    unsigned char valid[EEPROM_SIZE]; // Non-zero once the byte matches the device
+    int written;                      // Device changed during this run
+    int checksumKnown;                // Parameter region loaded and checksum verified
+    int checksumStatus;               // CHECKSUM_OK, CHECKSUM_BLANK or CHECKSUM_BAD
+    uint32_t checksum;                // Checksum the block should carry, patched on updates
+    int deferred;                     // Queue writes in pending instead of writing them
+    int pendingCount;
+    ShadowRange pending[SHADOW_MAX_PENDING];
+} EepromShadow;
+
+// Header of the persisted shadow file. The bus, the device address and the
+// stored checksum tie it to one device: boards with the same generation
+// count would otherwise share it.
+typedef struct {
+    unsigned int magic;
+    unsigned int generation;
+    unsigned int offset;
+    unsigned int length;
+    unsigned int address;
+    char bus[64];
+} ShadowFileHeader;
+
+// Write statistics, reported at exit
+typedef struct {
+    unsigned long bytes;
+    unsigned long pages;
+    unsigned long polls;
+    unsigned long skipped; // Bytes that already held the requested value
+    double seconds;
+} EepromWriteStats;
+
+static __thread EepromWriteStats writeStats;
+
+// Look up a part by name, returns NULL if unknown
+const EepromPart *findEepromPart(const char *name) {
+    for (unsigned int i = 0; i < EEPROM_PART_COUNT; i++) {
+        if (strcasecmp(eepromParts[i].name, name) == 0) {
+            return &eepromParts[i];
+        }
+    }
+    return NULL;
+}
+
+// Monotonic time in seconds
+static double monotonicSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Function to open a bus: an i2c-dev adapter, or the simulator for sim[...] paths
+int openEEPROMBus(I2cBus *bus, const char *path, const EepromPart *part) {
+    int status = eepromSimPath(path) ? eepromSimOpen(bus, path, part->size, eepromPageSize, part->addressBytes)
+                                     : i2cDevOpen(bus, path);
+    bus->path = path;
+    return status;
+}
+
+// Function to pick the transfer strategy from the adapter capabilities.
+// Plain I2C adapters get combined I2C_RDWR transfers; SMBus-only adapters
+// fall back to I2C-block writes and sequential byte reads, or I2C-block
+// reads when the whole memory address fits the command byte.
+int detectAdapter(I2cBus *bus, int forceSmbus) {
+    unsigned long funcs = 0;
+
+    if (i2cFunctions(bus, &funcs) < 0) {
+        perror("Failed to query adapter functionality");
+        return -1;
+    }
+
+    if ((funcs & I2C_FUNC_I2C) && !forceSmbus) {
+        transferMode = XFER_I2C;
+        return 0;
+    }
+
+    unsigned long blockReads = eepromAddressBytes == 1 ? funcs & I2C_FUNC_SMBUS_READ_I2C_BLOCK : 0;
+    unsigned long smbusNeeded = I2C_FUNC_SMBUS_WRITE_I2C_BLOCK | (blockReads ? blockReads : I2C_FUNC_SMBUS_READ_BYTE) |
+                                (eepromAddressBytes == 1 ? I2C_FUNC_SMBUS_WRITE_BYTE : I2C_FUNC_SMBUS_WRITE_BYTE_DATA);
+    if ((funcs & smbusNeeded) == smbusNeeded) {
+        transferMode = blockReads ? XFER_SMBUS_BLOCK : XFER_SMBUS;
+        return 0;
+    }
+
+    fprintf(stderr, "Adapter supports neither I2C nor SMBus I2C-block transfers\n");
+    return -1;
+}
+
+// Function to find the slave address that holds a memory address: the
+// address bits above the address bytes go in its low bits
+static unsigned short eepromSlaveFor(unsigned int address) {
+    return eepromAddress | (address >> (8 * eepromAddressBytes));
+}
+
+// Function to store the address bytes of a transfer, most significant first.
+// Returns their number.
+static int eepromAddressEncode(unsigned int address, unsigned char *buffer) {
+    if (eepromAddressBytes == 1) {
+        buffer[0] = address & 0xFF;
+        return 1;
+    }
+    buffer[0] = (address >> 8) & 0xFF; // High byte
+    buffer[1] = address & 0xFF;        // Low byte
+    return 2;
+}
+
+// Function to point the fd at the slave address holding a memory address,
+// for writes and SMBus transfers that use the I2C_SLAVE address
+static int selectEEPROMBlock(I2cBus *bus, unsigned int address) {
+    unsigned short slave = eepromSlaveFor(address);
+
+    if (slave != selectedSlave) {
+        if (i2cSetSlave(bus, slave) < 0) {
+            return -1;
+        }
+        selectedSlave = slave;
+    }
+    return 0;
+}
+
+// Function to set the EEPROM address pointer without transferring data
+int setEEPROMAddress(I2cBus *bus, unsigned int address) {
+    if (selectEEPROMBlock(bus, address) != 0) {
+        return -1;
+    }
+    if (transferMode != XFER_I2C) {
+        union i2c_smbus_data data;
+        if (eepromAddressBytes == 1) {
+            return i2cSmbus(bus, I2C_SMBUS_WRITE, address & 0xFF, I2C_SMBUS_BYTE, NULL) < 0 ? -1 : 0;
+        }
+        data.byte = address & 0xFF;
+        return i2cSmbus(bus, I2C_SMBUS_WRITE, (address >> 8) & 0xFF, I2C_SMBUS_BYTE_DATA, &data) < 0 ? -1 : 0;
+    }
+
+    unsigned char buffer[2];
+    int length = eepromAddressEncode(address, buffer);
+    return i2cWrite(bus, buffer, length) == length ? 0 : -1;
+}
+
+// Function to address another device on the bus.
+// Writes go to the I2C_SLAVE address of the fd, combined reads carry
+// eepromAddress in their messages, so both are switched together.
+int selectEEPROMDevice(I2cBus *bus, unsigned short address) {
+    if (i2cSetSlave(bus, address) < 0) {
+        return -1;
+    }
+    eepromAddress = address;
+    selectedSlave = address;
+    return 0;
+}
+
+// Function to check whether an ACK polling failure means the device is
+// still busy with its write cycle rather than a bus error
+static int eepromBusyError(int error) {
+    return error == EREMOTEIO || error == ENXIO || error == EAGAIN || error == EIO;
+}
+
+// Function to wait for the EEPROM write cycle by ACK polling.
+// The device NACKs its address while the internal write is in progress,
+// so keep addressing it until it answers again.
+int waitForEEPROMReady(I2cBus *bus, unsigned int address) {
+    double deadline = monotonicSeconds() + EEPROM_WRITE_TIMEOUT_MS / 1000.0;
+    uint64_t metricStart = eepromMetricStart();
+    unsigned long polls = 0;
+
+    for (;;) {
+        writeStats.polls++;
+        polls++;
+        if (setEEPROMAddress(bus, address) == 0) {
+            eepromMetricRecord(METRIC_POLL, metricStart, 0, polls, polls - 1, 0);
+            return 0;
+        }
+        if (!eepromBusyError(errno)) {
+            perror("ACK polling failed");
+            eepromMetricRecord(METRIC_POLL, metricStart, 0, polls, polls - 1, 1);
+            return -1;
+        }
+        if (monotonicSeconds() > deadline) {
+            fprintf(stderr, "EEPROM write cycle timed out at 0x%04X\n", address);
+            eepromMetricRecord(METRIC_POLL, metricStart, 0, polls, polls - 1, 1);
+            return -1;
+        }
+    }
+}
+
+// Function to send one page-bounded chunk to EEPROM (no wait for tWR)
+static int sendEEPROMPage(I2cBus *bus, unsigned int address, const char *data, int dataSize) {
+    unsigned char buffer[EEPROM_MAX_PAGE_SIZE + 2];
+
+    if (selectEEPROMBlock(bus, address) != 0) {
+        perror("Failed to select the EEPROM block");
+        return -1;
+    }
+    if (transferMode != XFER_I2C) {
+        // The first address byte is the command, a 2-byte address's low byte leads the block
+        union i2c_smbus_data block;
+        int header = eepromAddressBytes - 1;
+        block.block[0] = dataSize + header;
+        block.block[1] = address & 0xFF;
+        memcpy(&block.block[1 + header], data, dataSize);
+        unsigned char command = header ? (address >> 8) & 0xFF : address & 0xFF;
+        if (i2cSmbus(bus, I2C_SMBUS_WRITE, command, I2C_SMBUS_I2C_BLOCK_DATA, &block) < 0) {
+            perror("Write failed");
+            return -1;
+        }
+        return 0;
+    }
+
+    // Set the EEPROM memory address
+    int header = eepromAddressEncode(address, buffer);
+
+    // Copy data to the buffer
+    memcpy(&buffer[header], data, dataSize);
+
+    // Write data to EEPROM
+    if (i2cWrite(bus, buffer, dataSize + header) != dataSize + header) {
+        perror("Write failed");
+        return -1;
+    }
+    return 0;
+}
+
+// Function to write one page-bounded chunk to EEPROM and record its timing
+int writeEEPROMPage(I2cBus *bus, unsigned int address, const char *data, int dataSize) {
+    uint64_t metricStart = eepromMetricStart();
+    int status = sendEEPROMPage(bus, address, data, dataSize);
+
+    eepromMetricRecord(METRIC_WRITE, metricStart, status == 0 ? dataSize : 0, 1, 0, status != 0);
+    return status;
+}
+
+// Function to size the next write so it never crosses a page boundary
+int eepromChunkLength(unsigned int address, int remaining) {
+    unsigned int pageRoom = eepromPageSize - (address % eepromPageSize);
+    int chunk = remaining;
+
+    if (chunk > (int)pageRoom) {
+        chunk = pageRoom;
+    }
+    // An SMBus block carries at most 32 bytes, including a 2-byte address's low byte
+    if (transferMode != XFER_I2C && chunk > I2C_SMBUS_BLOCK_MAX - (int)(eepromAddressBytes - 1)) {
+        chunk = I2C_SMBUS_BLOCK_MAX - (eepromAddressBytes - 1);
+    }
+    return chunk;
+}
+
+// Function to write data to EEPROM.
+// The range is split on page boundaries so no write wraps inside a page,
+// and each page is completed by ACK polling before the next one starts.
+int writeDataToEEPROM(I2cBus *bus, unsigned int address, const char *data, int dataSize) {
+    double start = monotonicSeconds();
+    int written = 0;
+
+    while (written < dataSize) {
+        int chunk = eepromChunkLength(address, dataSize - written);
+
+        if (writeEEPROMPage(bus, address, data + written, chunk) != 0) {
+            return -1;
+        }
+        if (waitForEEPROMReady(bus, address) != 0) {
+            return -1;
+        }
+
+        writeStats.bytes += chunk;
+        writeStats.pages++;
+        address += chunk;
+        written += chunk;
+    }
+
+    writeStats.seconds += monotonicSeconds() - start;
+    return 0;
+}
+
+// Function to print the programming rate and read transactions achieved so far
+void printWriteStats(void) {
+    if (writeStats.pages > 0 || writeStats.skipped > 0) {
+        printf("EEPROM write: %lu bytes in %lu pages (%lu polls), %lu bytes unchanged, %.2f ms, %.0f bytes/sec\n",
+               writeStats.bytes, writeStats.pages, writeStats.polls, writeStats.skipped, writeStats.seconds * 1000.0,
+               writeStats.seconds > 0 ? writeStats.bytes / writeStats.seconds : 0.0);
+    }
+    if (readStats.transactions > 0) {
+        printf("EEPROM read: %lu bytes in %lu transactions\n", readStats.bytes, readStats.transactions);
+    }
+}
+
+// Function to receive data from EEPROM.
+// With plain I2C each chunk is one I2C_RDWR transfer: the address write and
+// the read are joined by a repeated start, so no other master can move the
+// address pointer in between. Chunks are sized to the adapter maximum.
+static int receiveEEPROMData(I2cBus *bus, unsigned int address, char *data, int dataSize) {
+    // The address counter wraps within a block, so no read crosses one
+    unsigned int blockSize = 1u << (8 * eepromAddressBytes);
+
+    int done = 0;
+    while (done < dataSize) {
+        unsigned int chunkAddress = address + done;
+        int chunk = dataSize - done;
+        if ((unsigned int)chunk > blockSize - chunkAddress % blockSize) {
+            chunk = blockSize - chunkAddress % blockSize;
+        }
+
+        if (transferMode == XFER_SMBUS_BLOCK) {
+            // The address is the command byte, each transaction reads up to 32 bytes
+            if (chunk > I2C_SMBUS_BLOCK_MAX) {
+                chunk = I2C_SMBUS_BLOCK_MAX;
+            }
+            union i2c_smbus_data block;
+            block.block[0] = chunk;
+            if (selectEEPROMBlock(bus, chunkAddress) != 0 ||
+                i2cSmbus(bus, I2C_SMBUS_READ, chunkAddress & 0xFF, I2C_SMBUS_I2C_BLOCK_DATA, &block) < 0) {
+                perror("Read failed");
+                return -1;
+            }
+            memcpy(data + done, &block.block[1], chunk);
+            readStats.transactions++;
+            readStats.bytes += chunk;
+            done += chunk;
+            continue;
+        }
+        if (transferMode == XFER_SMBUS) {
+            // Set the pointer once, then sequential current-address reads
+            if (setEEPROMAddress(bus, chunkAddress) != 0) {
+                perror("Write failed");
+                return -1;
+            }
+            readStats.transactions++;
+            for (int i = 0; i < chunk; i++) {
+                union i2c_smbus_data byte;
+                if (i2cSmbus(bus, I2C_SMBUS_READ, 0, I2C_SMBUS_BYTE, &byte) < 0) {
+                    perror("Read failed");
+                    return -1;
+                }
+                data[done + i] = byte.byte;
+                readStats.transactions++;
+            }
+            readStats.bytes += chunk;
+            done += chunk;
+            continue;
+        }
+
+        if (chunk > (int)maxTransferSize) {
+            chunk = maxTransferSize;
+        }
+
+        unsigned char buffer[2];
+        int header = eepromAddressEncode(chunkAddress, buffer);
+        unsigned short slave = eepromSlaveFor(chunkAddress);
+
+        struct i2c_msg messages[2] = {
+            {slave, 0, header, buffer},
+            {slave, I2C_M_RD, chunk, (unsigned char *)data + done},
+        };
+        if (i2cTransfer(bus, messages, 2) != 2) {
+            perror("Read failed");
+            return -1;
+        }
+        readStats.transactions++;
+        readStats.bytes += chunk;
+        done += chunk;
+    }
+    return 0;
+}
+
+// Function to read data from EEPROM and record its timing
+int readDataFromEEPROM(I2cBus *bus, unsigned int address, char *data, int dataSize) {
+    uint64_t metricStart = eepromMetricStart();
+    unsigned long transactions = readStats.transactions;
+    int status = receiveEEPROMData(bus, address, data, dataSize);
+
+    eepromMetricRecord(METRIC_READ, metricStart, status == 0 ? dataSize : 0,
+                       readStats.transactions - transactions, 0, status != 0);
+    return status;
+}
+
+// Function to verify the parameter region once it is in the shadow.
+// A bad block keeps its stored checksum as the base for later patches, so
+// updates never hide an existing corruption.
+void shadowVerify(EepromShadow *shadow) {
+    uint32_t computed;
+    uint32_t stored = eepromGetU32(shadow->data + eepromLayout->offset[FIELD_CHECKSUM]);
+
+    shadow->checksumStatus = eepromChecksumVerify(eepromLayout, shadow->data, &computed);
+    shadow->checksum = shadow->checksumStatus == CHECKSUM_BAD ? stored : computed;
+    shadow->checksumKnown = 1;
+    if (shadow->checksumStatus == CHECKSUM_BAD) {
+        fprintf(stderr, "Warning: parameter block checksum mismatch (stored 0x%08X, computed 0x%08X)\n", stored, computed);
+    }
+}
+
+// Function to make a range of the shadow valid.
+// The first access to the parameter region reads the whole region in one
+// burst; afterwards only bytes never seen before go to the bus.
+int shadowLoad(I2cBus *bus, EepromShadow *shadow, unsigned int offset, int length) {
+    unsigned int end = offset + length;
+
+    if (offset < PARAMETER_REGION_END && end > PARAMETER_REGION_OFFSET) {
+        offset = offset < PARAMETER_REGION_OFFSET ? offset : PARAMETER_REGION_OFFSET;
+        end = end > PARAMETER_REGION_END ? end : PARAMETER_REGION_END;
+    }
+
+    unsigned int i = offset;
+    while (i < end) {
+        if (shadow->valid[i]) {
+            i++;
+            continue;
+        }
+        unsigned int runEnd = i;
+        while (runEnd < end && !shadow->valid[runEnd]) {
+            runEnd++;
+        }
+        if (readDataFromEEPROM(bus, i, shadow->data + i, runEnd - i) != 0) {
+            return -1;
+        }
+        memset(shadow->valid + i, 1, runEnd - i);
+        i = runEnd;
+    }
+
+    // Ranges touching the parameter region were widened to all of it
+    if (!shadow->checksumKnown && offset <= PARAMETER_REGION_OFFSET && end >= PARAMETER_REGION_END) {
+        shadowVerify(shadow);
+    }
+    return 0;
+}
+
+// Function to write a modified range of the shadow through to the device.
+// A deferred shadow only queues the range; the fleet scheduler writes it.
+int shadowStore(I2cBus *bus, EepromShadow *shadow, unsigned int offset, int length) {
+    if (shadow->deferred) {
+        if (shadow->pendingCount == SHADOW_MAX_PENDING) {
+            fprintf(stderr, "Too many pending writes for device 0x%02X\n", eepromAddress);
+            return -1;
+        }
+        shadow->pending[shadow->pendingCount++] = (ShadowRange){offset, length};
+        shadow->written = 1;
+        return 0;
+    }
+    if (writeDataToEEPROM(bus, offset, shadow->data + offset, length) != 0) {
+        // The device may hold a partial write, forget what we think it holds
+        memset(shadow->valid + offset, 0, length);
+        return -1;
+    }
+    memset(shadow->valid + offset, 1, length);
+    shadow->written = 1;
+    return 0;
+}
+
+// Function to update a range of the device with new contents (or a fill
+// value when data is NULL). Each page is compared with the shadow and only
+// the span of bytes that differ is written, so unchanged pages cost no bus
+// time, no write cycle and no wear.
+int shadowUpdate(I2cBus *bus, EepromShadow *shadow, unsigned int offset, const char *data, int fill, int length) {
+    unsigned int end = offset + length;
+    unsigned int position = offset;
+    char previous[EEPROM_SIZE];
+
+    if (shadowLoad(bus, shadow, offset, length) != 0) {
+        return -1;
+    }
+    memcpy(previous, shadow->data + offset, length);
+
+    while (position < end) {
+        unsigned int pageEnd = (position / eepromPageSize + 1) * eepromPageSize;
+        if (pageEnd > end) {
+            pageEnd = end;
+        }
+
+        unsigned int first = pageEnd, last = position;
+        for (unsigned int i = position; i < pageEnd; i++) {
+            char value = data ? data[i - offset] : (char)fill;
+            if (shadow->data[i] != value) {
+                if (first == pageEnd) {
+                    first = i;
+                }
+                last = i;
+                shadow->data[i] = value;
+            }
+        }
+
+        if (first == pageEnd) {
+            writeStats.skipped += pageEnd - position;
+        } else {
+            writeStats.skipped += (pageEnd - position) - (last - first + 1);
+            if (shadowStore(bus, shadow, first, last - first + 1) != 0) {
+                return -1;
+            }
+        }
+        position = pageEnd;
+    }
+
+    // Fields inside the checksummed block patch the checksum incrementally
+    if (offset < eepromLayout->offset[FIELD_CHECKSUM]) {
+        shadow->checksum = eepromChecksumPatch(eepromLayout, shadow->checksum, offset, previous,
+                                               shadow->data + offset, length);
+    }
+    return 0;
+}
+
+// Record log persistence: the bus and shadow the records go through
+typedef struct {
+    I2cBus *bus;
+    EepromShadow *shadow;
+} ShadowLogTarget;
+
+// Function to write a log record through the shadow. Records live outside
+// the parameter region, so they leave the generation stamp alone and an
+// update costs exactly one page write.
+static int shadowLogWrite(void *context, unsigned int offset, const char *record, unsigned int length) {
+    ShadowLogTarget *target = context;
+    int written = target->shadow->written;
+    int status = shadowUpdate(target->bus, target->shadow, offset, record, 0, length);
+
+    target->shadow->written = written;
+    return status;
+}
+
+// Function to read the log area into the shadow and rebuild the latest values
+int shadowLogScan(I2cBus *bus, EepromShadow *shadow, EepromLog *log) {
+    unsigned int begin = eepromLogBegin(eepromLayout);
+
+    if (begin < eepromImageSize && shadowLoad(bus, shadow, begin, eepromImageSize - begin) != 0) {
+        return -1;
+    }
+    eepromLogScan(log, eepromLayout, shadow->data, eepromImageSize);
+    return 0;
+}
+
+// Function to dump the whole image as it is on the device
+void printShadowDump(I2cBus *bus, EepromShadow *shadow) {
+    if (shadowLoad(bus, shadow, 0, eepromImageSize) == 0) {
+        uint64_t metricStart = eepromMetricStart();
+        printHexDump(shadow->data, eepromImageSize);
+        eepromMetricRecord(METRIC_DUMP, metricStart, eepromImageSize, 1, 0, 0);
+    }
+}
+
+// Function to report streaming progress and throughput on stderr. On a
+// terminal the line is redrawn a few times a second, otherwise only the
+// final line is printed.
+static void streamProgress(const char *what, unsigned int done, unsigned int total, double start, double *lastReport) {
+    double now = monotonicSeconds();
+    int final = done == total;
+
+    if (!final && (!isatty(STDERR_FILENO) || now - *lastReport < 0.25)) {
+        return;
+    }
+    *lastReport = now;
+    double elapsed = now - start;
+    fprintf(stderr, "\r%s: %u/%u bytes (%u%%), %.0f bytes/sec%s", what, done, total,
+            total ? (unsigned int)((unsigned long long)done * 100 / total) : 100,
+            elapsed > 0 ? done / elapsed : 0.0, final ? "\n" : "");
+}
+
+// Function to copy the whole device to a file. Data moves through one
+// fixed buffer in adapter-sized reads, so memory use does not grow with
+// the part.
+int dumpEEPROM(I2cBus *bus, const char *path) {
+    char buffer[EEPROM_STREAM_BUFFER];
+    double start = monotonicSeconds(), lastReport = 0;
+    uint64_t metricStart = eepromMetricStart();
+    unsigned int done = 0;
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        perror(path);
+        return 1;
+    }
+    while (done < eepromPartSize) {
+        unsigned int chunk = eepromPartSize - done < sizeof(buffer) ? eepromPartSize - done : sizeof(buffer);
+        if (readDataFromEEPROM(bus, done, buffer, chunk) != 0) {
+            break;
+        }
+        if (fwrite(buffer, 1, chunk, file) != chunk) {
+            perror(path);
+            break;
+        }
+        done += chunk;
+        streamProgress("Dump", done, eepromPartSize, start, &lastReport);
+    }
+    if (fclose(file) != 0 && done == eepromPartSize) {
+        perror(path);
+        done = 0;
+    }
+    eepromMetricRecord(METRIC_DUMP, metricStart, done, 1, 0, done != eepromPartSize);
+    return done == eepromPartSize ? 0 : 1;
+}
+
+// Function to write a file back to the device. Each buffer is read from
+// the device first and only the differing span of every page is written,
+// so restoring onto a mostly matching part costs little more than a read.
+int restoreEEPROM(I2cBus *bus, const char *path) {
+    char buffer[EEPROM_STREAM_BUFFER];
+    char device[EEPROM_STREAM_BUFFER];
+    double start = monotonicSeconds(), lastReport = 0;
+    struct stat info;
+    unsigned int done = 0;
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return 1;
+    }
+    if (fstat(fileno(file), &info) != 0 || info.st_size > (off_t)eepromPartSize) {
+        printf("%s does not fit the part (%u bytes).\n", path, eepromPartSize);
+        fclose(file);
+        return 1;
+    }
+
+    unsigned int total = info.st_size;
+    while (done < total) {
+        unsigned int chunk = total - done < sizeof(buffer) ? total - done : sizeof(buffer);
+        if (fread(buffer, 1, chunk, file) != chunk) {
+            perror(path);
+            break;
+        }
+        if (readDataFromEEPROM(bus, done, device, chunk) != 0) {
+            break;
+        }
+
+        // Page spans are relative to the device, the buffer may start mid-page
+        unsigned int position = 0;
+        while (position < chunk) {
+            unsigned int pageEnd = ((done + position) / eepromPageSize + 1) * eepromPageSize - done;
+            if (pageEnd > chunk) {
+                pageEnd = chunk;
+            }
+
+            unsigned int first = pageEnd, last = position;
+            for (unsigned int i = position; i < pageEnd; i++) {
+                if (buffer[i] != device[i]) {
+                    if (first == pageEnd) {
+                        first = i;
+                    }
+                    last = i;
+                }
+            }
+
+            if (first == pageEnd) {
+                writeStats.skipped += pageEnd - position;
+            } else {
+                writeStats.skipped += (pageEnd - position) - (last - first + 1);
+                if (writeDataToEEPROM(bus, done + first, buffer + first, last - first + 1) != 0) {
+                    break;
+                }
+            }
+            position = pageEnd;
+        }
+        if (position < chunk) {
+            break;
+        }
+        done += chunk;
+        streamProgress("Restore", done, total, start, &lastReport);
+    }
+    fclose(file);
+    return done == total ? 0 : 1;
+}
+
+// Function to read the generation stamp held in the shadow
+unsigned int shadowGeneration(const EepromShadow *shadow) {
+    return eepromGetU32(shadow->data + GENERATION_OFFSET);
+}
+
+// Function to name the bus in a shadow file header
+static void shadowBusName(const I2cBus *bus, char *name, size_t size) {
+    memset(name, 0, size);
+    snprintf(name, size, "%s", bus->path ? bus->path : "");
+}
+
+// Function to reuse a persisted parameter region when it was saved for
+// this bus and address, and the device generation stamp and checksum still
+// match, so nothing else has to be read
+int shadowRestore(I2cBus *bus, EepromShadow *shadow, const char *path) {
+    ShadowFileHeader header;
+    char region[EEPROM_LAYOUT_LIMIT];
+    char busName[sizeof(header.bus)];
+    unsigned int regionLength = PARAMETER_REGION_END - PARAMETER_REGION_OFFSET;
+    unsigned int checksumOffset = eepromLayout->offset[FIELD_CHECKSUM];
+
+    uint64_t metricStart = eepromMetricStart();
+    FILE *shadowFile = fopen(path, "rb");
+    if (!shadowFile) {
+        return 0;
+    }
+    int usable = fread(&header, sizeof(header), 1, shadowFile) == 1 &&
+                 header.magic == SHADOW_MAGIC &&
+                 header.offset == PARAMETER_REGION_OFFSET &&
+                 header.length == regionLength &&
+                 fread(region, 1, regionLength, shadowFile) == regionLength;
+    shadowBusName(bus, busName, sizeof(busName));
+    usable = usable && header.address == eepromAddress && memcmp(header.bus, busName, sizeof(busName)) == 0;
+    fclose(shadowFile);
+    eepromMetricRecord(METRIC_LOAD, metricStart, usable ? sizeof(header) + regionLength : 0, 1, 0, !usable);
+    if (!usable) {
+        return 0;
+    }
+
+    if (readDataFromEEPROM(bus, GENERATION_OFFSET, shadow->data + GENERATION_OFFSET, GENERATION_LEN) != 0) {
+        return -1;
+    }
+    memset(shadow->valid + GENERATION_OFFSET, 1, GENERATION_LEN);
+    if (shadowGeneration(shadow) != header.generation) {
+        return 0;
+    }
+
+    // Another board with the same generation count has its own checksum
+    if (readDataFromEEPROM(bus, checksumOffset, shadow->data + checksumOffset, FIELD_LENGTH_CHECKSUM) != 0) {
+        return -1;
+    }
+    memset(shadow->valid + checksumOffset, 1, FIELD_LENGTH_CHECKSUM);
+    if (memcmp(shadow->data + checksumOffset, region + checksumOffset - PARAMETER_REGION_OFFSET,
+               FIELD_LENGTH_CHECKSUM) != 0) {
+        return 0;
+    }
+
+    memcpy(shadow->data + PARAMETER_REGION_OFFSET, region, regionLength);
+    memset(shadow->valid + PARAMETER_REGION_OFFSET, 1, regionLength);
+    shadowVerify(shadow);
+    return 0;
+}
+
+// Function to bump the generation stamp after writes and persist the shadow
+int shadowFinish(I2cBus *bus, EepromShadow *shadow, const char *path) {
+    if (shadow->written) {
+        if (shadowLoad(bus, shadow, GENERATION_OFFSET, GENERATION_LEN) != 0) {
+            return -1;
+        }
+        char stamp[GENERATION_LEN];
+        eepromPutU32(stamp, shadowGeneration(shadow) + 1);
+        if (shadowUpdate(bus, shadow, GENERATION_OFFSET, stamp, 0, GENERATION_LEN) != 0) {
+            return -1;
+        }
+
+        // The checksum goes last, so an interrupted run is detected on the next load
+        char checksum[FIELD_LENGTH_CHECKSUM];
+        eepromPutU32(checksum, shadow->checksum);
+        if (shadowUpdate(bus, shadow, eepromLayout->offset[FIELD_CHECKSUM], checksum, 0, FIELD_LENGTH_CHECKSUM) != 0) {
+            return -1;
+        }
+    }
+
+    if (!path) {
+        return 0;
+    }
+    for (unsigned int i = PARAMETER_REGION_OFFSET; i < PARAMETER_REGION_END; i++) {
+        if (!shadow->valid[i]) {
+            return 0;
+        }
+    }
+
+    ShadowFileHeader header = {SHADOW_MAGIC, shadowGeneration(shadow), PARAMETER_REGION_OFFSET,
+                               PARAMETER_REGION_END - PARAMETER_REGION_OFFSET, eepromAddress, ""};
+    shadowBusName(bus, header.bus, sizeof(header.bus));
+    uint64_t metricStart = eepromMetricStart();
+    FILE *shadowFile = fopen(path, "wb");
+    if (!shadowFile) {
+        perror("Failed to save shadow image");
+        eepromMetricRecord(METRIC_SAVE, metricStart, 0, 1, 0, 1);
+        return -1;
+    }
+    int ok = fwrite(&header, sizeof(header), 1, shadowFile) == 1 &&
+             fwrite(shadow->data + PARAMETER_REGION_OFFSET, 1, header.length, shadowFile) == header.length;
+    ok = fclose(shadowFile) == 0 && ok;
+    eepromMetricRecord(METRIC_SAVE, metricStart, ok ? sizeof(header) + header.length : 0, 1, 0, !ok);
+    if (!ok) {
+        perror("Failed to save shadow image");
+        return -1;
+    }
+    return 0;
+}
+
+// Fleet mode: a list of (bus, address, parameter set) jobs. Each bus gets
+// one worker thread that owns the bus fd, so access within a bus is
+// serialized while the buses run in parallel. Every device is read and
+// planned first; the queued pages of all devices on a bus are then written
+// round-robin, so one device's write cycle overlaps traffic to the others.
+
+// Job state
+#define FLEET_FAILED -1
+#define FLEET_PENDING 0
+#define FLEET_RUNNING 1
+#define FLEET_OK 2
+
+typedef struct {
+    int bus;                        // Index into the bus list
+    unsigned short address;
+    int line;                       // Line of the job file, for messages
+    int length[FIELD_COUNT];        // Bytes to write per field, 0 leaves it alone
+    char data[EEPROM_LAYOUT_LIMIT]; // Encoded field values at their layout offsets
+    EepromShadow *shadow;
+    int status;
+    const char *error;
+    int nextRange;                  // Pending range being written
+    unsigned int nextOffset;        // Bytes of that range already written
+    int busy;                       // Waiting for the write cycle of the last page
+    unsigned int busyAddress;
+    double busySince;
+    uint64_t pollStart;             // Metrics start of the current write cycle
+    unsigned long polls;            // ACK polls in the current write cycle
+    double start;
+    double seconds;
+    unsigned long bytes;
+    unsigned long pages;
+    unsigned long skipped;
+} FleetJob;
+
+typedef struct {
+    char path[64];
+    int forceSmbus;
+    const EepromPart *part;
+    FleetJob **jobs;
+    int jobCount;
+    pthread_t thread;
+    double seconds;
+    EepromWriteStats writeStats;
+    EepromReadStats readStats;
+} FleetBus;
+
+// Function to record why a job stopped
+static void fleetFail(FleetJob *job, const char *error) {
+    job->status = FLEET_FAILED;
+    job->error = error;
+}
+
+// Function to read a device and queue every write it needs
+static void fleetPrepare(I2cBus *bus, FleetJob *job) {
+    unsigned long skipped = writeStats.skipped;
+
+    job->shadow = calloc(1, sizeof(EepromShadow));
+    if (!job->shadow) {
+        fleetFail(job, "out of memory");
+        return;
+    }
+    job->shadow->deferred = 1;
+
+    if (selectEEPROMDevice(bus, job->address) != 0) {
+        fleetFail(job, "cannot address device");
+        return;
+    }
+    if (shadowLoad(bus, job->shadow, PARAMETER_REGION_OFFSET, PARAMETER_REGION_END - PARAMETER_REGION_OFFSET) != 0) {
+        fleetFail(job, "read failed");
+        return;
+    }
+    for (int id = 0; id < FIELD_COUNT; id++) {
+        unsigned int offset = eepromLayout->offset[id];
+        if (job->length[id] > 0 &&
+            shadowUpdate(bus, job->shadow, offset, job->data + offset, 0, job->length[id]) != 0) {
+            fleetFail(job, "too many pending writes");
+            return;
+        }
+    }
+    // Generation stamp and checksum are queued last, as in a single run
+    if (shadowFinish(bus, job->shadow, NULL) != 0) {
+        fleetFail(job, "too many pending writes");
+        return;
+    }
+
+    job->skipped = writeStats.skipped - skipped;
+    job->status = FLEET_RUNNING;
+    job->start = monotonicSeconds();
+}
+
+// Function to write the queued pages of every device on one bus.
+// A device still in its write cycle is skipped while the others get their
+// next page, so the bus only idles when every device is busy.
+static void fleetDrainBus(I2cBus *bus, FleetJob **jobs, int count) {
+    int active = 1;
+
+    while (active) {
+        active = 0;
+        for (int i = 0; i < count; i++) {
+            FleetJob *job = jobs[i];
+            EepromShadow *shadow = job->shadow;
+            if (job->status != FLEET_RUNNING) {
+                continue;
+            }
+            if (selectEEPROMDevice(bus, job->address) != 0) {
+                fleetFail(job, "cannot address device");
+                continue;
+            }
+
+            if (job->busy) {
+                writeStats.polls++;
+                job->polls++;
+                if (setEEPROMAddress(bus, job->busyAddress) != 0) {
+                    if (!eepromBusyError(errno)) {
+                        fleetFail(job, "ACK polling failed");
+                        eepromMetricRecord(METRIC_POLL, job->pollStart, 0, job->polls, job->polls - 1, 1);
+                    } else if (monotonicSeconds() > job->busySince + EEPROM_WRITE_TIMEOUT_MS / 1000.0) {
+                        fleetFail(job, "write cycle timed out");
+                        eepromMetricRecord(METRIC_POLL, job->pollStart, 0, job->polls, job->polls - 1, 1);
+                    } else {
+                        active = 1;
                     }
+                    continue;
                 }
-                printf("\n");
+                eepromMetricRecord(METRIC_POLL, job->pollStart, 0, job->polls, job->polls - 1, 0);
+                job->busy = 0;
+            }
+
+            if (job->nextRange == shadow->pendingCount) {
+                job->status = FLEET_OK;
+                job->seconds = monotonicSeconds() - job->start;
+                continue;
+            }
+
+            ShadowRange *range = &shadow->pending[job->nextRange];
+            unsigned int address = range->offset + job->nextOffset;
+            int chunk = eepromChunkLength(address, range->length - job->nextOffset);
+            if (writeEEPROMPage(bus, address, shadow->data + address, chunk) != 0) {
+                fleetFail(job, "write failed");
+                continue;
+            }
+
+            job->bytes += chunk;
+            job->pages++;
+            writeStats.bytes += chunk;
+            writeStats.pages++;
+            job->nextOffset += chunk;
+            if (job->nextOffset == range->length) {
+                job->nextRange++;
+                job->nextOffset = 0;
             }
-            printf("0x%04X: ", i);
+            job->busy = 1;
+            job->busyAddress = address;
+            job->busySince = monotonicSeconds();
+            job->pollStart = eepromMetricStart();
+            job->polls = 0;
+            active = 1;
         }
-        printf("%02X ", (unsigned char)data[i]);
     }
-
-    printf("\n");
 }
 
-// Function to write data to EEPROM
-int writeDataToEEPROM(int file, unsigned int address, const char *data, int dataSize) {
-    unsigned char buffer[dataSize + 2];
+// Function to program every device on one bus, run as the bus worker thread
+static void *fleetBusWorker(void *arg) {
+    FleetBus *fleetBus = arg;
+    double start = monotonicSeconds();
+    I2cBus bus;
 
-    // Set the EEPROM memory address
-    buffer[0] = (address >> 8) & 0xFF; // High byte
-    buffer[1] = address & 0xFF;        // Low byte
+    int opened = openEEPROMBus(&bus, fleetBus->path, fleetBus->part) == 0;
+    if (!opened || detectAdapter(&bus, fleetBus->forceSmbus) != 0) {
+        for (int i = 0; i < fleetBus->jobCount; i++) {
+            fleetFail(fleetBus->jobs[i], opened ? "unsupported adapter" : "cannot open bus");
+        }
+    } else {
+        for (int i = 0; i < fleetBus->jobCount; i++) {
+            fleetPrepare(&bus, fleetBus->jobs[i]);
+        }
+        fleetDrainBus(&bus, fleetBus->jobs, fleetBus->jobCount);
+    }
+    if (opened) {
+        i2cClose(&bus);
+    }
 
-    // Copy data to the buffer
-    memcpy(&buffer[2], data, dataSize);
+    fleetBus->writeStats = writeStats;
+    fleetBus->readStats = readStats;
+    fleetBus->seconds = monotonicSeconds() - start;
+    return NULL;
+}
 
-    // Write data to EEPROM
-    if (write(file, buffer, dataSize + 2) != dataSize + 2) {
-        perror("Write failed");
+// Function to parse one job line: <bus> <address> [KEY=value ...].
+// An empty value clears the field. Returns 0, or -1 after printing why.
+static int fleetParseJob(char *line, int lineNumber, FleetJob *job, char *bus, size_t busSize) {
+    char *save;
+    char *token = strtok_r(line, " \t\r\n", &save);
+    char *address = strtok_r(NULL, " \t\r\n", &save);
+    char *end;
+
+    memset(job, 0, sizeof(*job));
+    job->line = lineNumber;
+    if (!address || strlen(token) >= busSize) {
+        printf("Fleet file line %d: expected <bus> <address> [KEY=value ...].\n", lineNumber);
+        return -1;
+    }
+    snprintf(bus, busSize, "%s", token);
+
+    long value = strtol(address, &end, 0);
+    if (*end != '\0' || value < 0x03 || value > 0x77) {
+        printf("Fleet file line %d: invalid device address %s.\n", lineNumber, address);
         return -1;
     }
+    job->address = value;
+
+    while ((token = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+        char *arg = strchr(token, '=');
+        int field = -1;
+        if (arg) {
+            *arg++ = '\0';
+            field = eepromFieldForKey(token);
+        }
+        if (field < 0) {
+            printf("Fleet file line %d: unknown parameter %s.\n", lineNumber, token);
+            return -1;
+        }
+
+        char *out = job->data + eepromLayout->offset[field];
+        if (*arg == '\0') {
+            memset(out, 0, eepromFields[field].length);
+            job->length[field] = eepromFields[field].length;
+        } else {
+            job->length[field] = eepromFieldEncode(field, arg, out);
+            if (job->length[field] < 0) {
+                printf("Fleet file line %d: invalid %s.\n", lineNumber, token);
+                return -1;
+            }
+        }
+    }
     return 0;
 }
 
-// Function to read data from EEPROM
-int readDataFromEEPROM(int file, unsigned int address, char *data, int dataSize) {
-    unsigned char buffer[2];
+// Function to run every job of a fleet file and report per-device status.
+// Returns 0 when every device was programmed.
+int runFleet(const char *path, const EepromPart *part, int forceSmbus) {
+    FILE *jobFile = fopen(path, "r");
+    if (!jobFile) {
+        perror("Failed to open fleet file");
+        return 1;
+    }
 
-    // Set the EEPROM memory address
-    buffer[0] = (address >> 8) & 0xFF; // High byte
-    buffer[1] = address & 0xFF;        // Low byte
+    FleetJob *jobs = NULL;
+    FleetBus *buses = NULL;
+    int jobCount = 0, busCount = 0, lineNumber = 0, status = 0;
+    char line[1024];
 
-    // Write the address to the EEPROM
-    if (write(file, buffer, 2) != 2) {
-        perror("Write failed");
-        return -1;
+    // Field messages would interleave across devices, the report replaces them
+    eepromFieldMessages = 0;
+    while (fgets(line, sizeof(line), jobFile)) {
+        char bus[sizeof(buses->path)];
+        lineNumber++;
+        if (line[strspn(line, " \t\r\n")] == '\0' || line[strspn(line, " \t")] == '#') {
+            continue;
+        }
+
+        FleetJob *grown = realloc(jobs, (jobCount + 1) * sizeof(FleetJob));
+        if (!grown) {
+            perror("Failed to load fleet file");
+            status = 1;
+            break;
+        }
+        jobs = grown;
+        FleetJob *job = &jobs[jobCount];
+        if (fleetParseJob(line, lineNumber, job, bus, sizeof(bus)) != 0) {
+            status = 1;
+            break;
+        }
+
+        for (job->bus = 0; job->bus < busCount; job->bus++) {
+            if (strcmp(buses[job->bus].path, bus) == 0) {
+                break;
+            }
+        }
+        if (job->bus == busCount) {
+            FleetBus *more = realloc(buses, (busCount + 1) * sizeof(FleetBus));
+            if (!more) {
+                perror("Failed to load fleet file");
+                status = 1;
+                break;
+            }
+            buses = more;
+            memset(&buses[busCount], 0, sizeof(FleetBus));
+            snprintf(buses[busCount].path, sizeof(buses->path), "%s", bus);
+            buses[busCount].forceSmbus = forceSmbus;
+            buses[busCount].part = part;
+            busCount++;
+        }
+        for (int i = 0; i < jobCount; i++) {
+            if (jobs[i].bus == job->bus && jobs[i].address == job->address) {
+                printf("Fleet file line %d: device 0x%02X on %s is already listed on line %d.\n",
+                       lineNumber, job->address, bus, jobs[i].line);
+                status = 1;
+            }
+        }
+        jobCount++;
+    }
+    fclose(jobFile);
+
+    for (int b = 0; b < busCount && status == 0; b++) {
+        buses[b].jobs = malloc(jobCount * sizeof(FleetJob *));
+        if (!buses[b].jobs) {
+            perror("Failed to schedule fleet");
+            status = 1;
+            break;
+        }
+        for (int i = 0; i < jobCount; i++) {
+            if (jobs[i].bus == b) {
+                buses[b].jobs[buses[b].jobCount++] = &jobs[i];
+            }
+        }
+    }
+
+    if (status == 0) {
+        // Build the CRC tables before the workers share them
+        crc32cInit();
+        double start = monotonicSeconds();
+        int started = 0;
+        for (; started < busCount; started++) {
+            if (pthread_create(&buses[started].thread, NULL, fleetBusWorker, &buses[started]) != 0) {
+                perror("Failed to start bus worker");
+                status = 1;
+                break;
+            }
+        }
+        for (int b = 0; b < started; b++) {
+            pthread_join(buses[b].thread, NULL);
+        }
+        double seconds = monotonicSeconds() - start;
+
+        // Per-device status in job file order
+        unsigned long bytes = 0;
+        int failed = 0;
+        for (int i = 0; i < jobCount; i++) {
+            FleetJob *job = &jobs[i];
+            if (job->status == FLEET_OK) {
+                printf("%s 0x%02X: OK, %lu bytes in %lu pages, %lu bytes unchanged, %.2f ms\n",
+                       buses[job->bus].path, job->address, job->bytes, job->pages, job->skipped, job->seconds * 1000.0);
+            } else {
+                printf("%s 0x%02X: FAILED (%s) after %lu bytes\n", buses[job->bus].path, job->address,
+                       job->error ? job->error : "not started", job->bytes);
+                failed++;
+            }
+        }
+
+        double slowest = 0;
+        for (int b = 0; b < busCount; b++) {
+            FleetBus *bus = &buses[b];
+            printf("%s: %d devices, %lu bytes in %lu pages (%lu polls), %lu bytes read, %.2f ms\n", bus->path,
+                   bus->jobCount, bus->writeStats.bytes, bus->writeStats.pages, bus->writeStats.polls,
+                   bus->readStats.bytes, bus->seconds * 1000.0);
+            bytes += bus->writeStats.bytes;
+            slowest = bus->seconds > slowest ? bus->seconds : slowest;
+        }
+        printf("Fleet: %d devices on %d buses, %d failed, %lu bytes in %.2f ms (slowest bus %.2f ms), %.0f bytes/sec\n",
+               jobCount, busCount, failed, bytes, seconds * 1000.0, slowest * 1000.0, seconds > 0 ? bytes / seconds : 0.0);
+        if (failed) {
+            status = 1;
+        }
+    }
+
+    for (int i = 0; i < jobCount; i++) {
+        free(jobs[i].shadow);
+    }
+    for (int b = 0; b < busCount; b++) {
+        free(buses[b].jobs);
+    }
+    free(jobs);
+    free(buses);
+    return status;
+}
+
+// Daemon mode: keep the bus open and a verified shadow in memory, and
+// serve requests from local clients over a Unix-domain socket.
+//
+// The main thread runs an epoll loop over the socket and every client.
+// get, dump and verify are answered from a published copy of the shadow
+// without touching the bus. set and clear go onto a single queue that one
+// writer thread drains, so device writes are serialized and never stall
+// the readers. A client's later requests wait until its pending write
+// completes, so its replies stay in order.
+//
+// Protocol, one request per line, every reply ending with OK or ERR:
+//   get <KEY>          OK <value>
+//   set <KEY> <value>  OK        (value as for --upd<KEY>)
+//   clear <KEY>        OK
+//   dump               hex dump lines, then OK
+//   verify             OK ok|blank|mismatch
+//   metrics            Prometheus text lines, then OK
+//   quit
+
+#define DAEMON_LINE_MAX 512
+#define DAEMON_MAX_EVENTS 64
+
+typedef struct DaemonClient {
+    int fd;
+    char in[DAEMON_LINE_MAX];
+    size_t inLength;
+    char *out;
+    size_t outLength;
+    size_t outCapacity;
+    int waiting; // A write is queued, later requests wait for its reply
+    int closed;  // Connection gone, freed once its write completes
+    struct DaemonClient *nextFree;
+} DaemonClient;
+
+typedef struct DaemonRequest {
+    DaemonClient *client;
+    int field;
+    int clear;
+    char arg[DAEMON_LINE_MAX];
+    const char *reply;
+    struct DaemonRequest *next;
+} DaemonRequest;
+
+typedef struct {
+    I2cBus *bus;
+    EepromShadow *shadow;
+    const char *shadowPath;
+    int epollFd;
+    int eventFd;
+
+    // Device state of the main thread, the writer starts from it
+    int transferMode;
+    unsigned short eepromAddress;
+    unsigned short selectedSlave;
+    EepromWriteStats writeStats; // Handed back by the writer for the exit report
+    EepromReadStats readStats;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    DaemonRequest *queueHead; // Waiting for the writer
+    DaemonRequest *queueTail;
+    DaemonRequest *done;      // Written, reply not sent yet
+    DaemonClient *released;   // Freed after the current event batch
+    int stopping;
+
+    // Published copy of the device, updated after every write
+    char image[EEPROM_SIZE];
+    int checksumStatus;
+} EepromDaemon;
+
+static volatile sig_atomic_t daemonStop;
+
+static void daemonSignal(int signal) {
+    (void)signal;
+    daemonStop = 1;
+}
+
+// Function to copy the shadow to the published image after a write
+static void daemonPublish(EepromDaemon *daemon) {
+    uint32_t computed;
+
+    pthread_mutex_lock(&daemon->lock);
+    memcpy(daemon->image, daemon->shadow->data, EEPROM_SIZE);
+    daemon->checksumStatus = eepromChecksumVerify(eepromLayout, daemon->image, &computed);
+    pthread_mutex_unlock(&daemon->lock);
+}
+
+// Function run by the writer thread: applies queued writes one at a time
+static void *daemonWriter(void *arg) {
+    EepromDaemon *daemon = arg;
+    char fieldData[EEPROM_LAYOUT_LIMIT];
+
+    // The thread-local device state starts at its defaults in a new thread
+    transferMode = daemon->transferMode;
+    eepromAddress = daemon->eepromAddress;
+    selectedSlave = daemon->selectedSlave;
+    for (;;) {
+        pthread_mutex_lock(&daemon->lock);
+        while (!daemon->queueHead && !daemon->stopping) {
+            pthread_cond_wait(&daemon->wake, &daemon->lock);
+        }
+        DaemonRequest *request = daemon->queueHead;
+        if (!request) {
+            pthread_mutex_unlock(&daemon->lock);
+            break;
+        }
+        daemon->queueHead = request->next;
+        pthread_mutex_unlock(&daemon->lock);
+
+        const EepromFieldInfo *field = &eepromFields[request->field];
+        int length = request->clear ? (int)field->length : eepromFieldEncode(request->field, request->arg, fieldData);
+        if (length <= 0) {
+            request->reply = "ERR invalid value\n";
+        } else if (shadowUpdate(daemon->bus, daemon->shadow, eepromLayout->offset[request->field],
+                                request->clear ? NULL : fieldData, 0, length) != 0 ||
+                   shadowFinish(daemon->bus, daemon->shadow, daemon->shadowPath) != 0) {
+            request->reply = "ERR write failed\n";
+        } else {
+            request->reply = "OK\n";
+        }
+        // The generation stamp is bumped once per request that changed the device
+        daemon->shadow->written = 0;
+        daemonPublish(daemon);
+
+        pthread_mutex_lock(&daemon->lock);
+        request->next = daemon->done;
+        daemon->done = request;
+        pthread_mutex_unlock(&daemon->lock);
+        uint64_t one = 1;
+        if (write(daemon->eventFd, &one, sizeof(one)) != sizeof(one)) {
+            perror("Failed to signal write completion");
+        }
+    }
+    daemon->writeStats = writeStats;
+    daemon->readStats = readStats;
+    return NULL;
+}
+
+// Function to queue reply bytes for a client
+static int daemonAppend(DaemonClient *client, const char *data, size_t length) {
+    if (client->outLength + length > client->outCapacity) {
+        size_t capacity = client->outCapacity ? client->outCapacity : 4096;
+        while (capacity < client->outLength + length) {
+            capacity *= 2;
+        }
+        char *grown = realloc(client->out, capacity);
+        if (!grown) {
+            return -1;
+        }
+        client->out = grown;
+        client->outCapacity = capacity;
+    }
+    memcpy(client->out + client->outLength, data, length);
+    client->outLength += length;
+    return 0;
+}
+
+// Function to send queued replies, waiting for EPOLLOUT when the socket is full
+static int daemonFlush(EepromDaemon *daemon, DaemonClient *client) {
+    size_t sent = 0;
+
+    while (sent < client->outLength) {
+        ssize_t put = send(client->fd, client->out + sent, client->outLength - sent, MSG_NOSIGNAL);
+        if (put < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return -1;
+        }
+        sent += put;
+    }
+    memmove(client->out, client->out + sent, client->outLength - sent);
+    client->outLength -= sent;
+
+    struct epoll_event event = {EPOLLIN | (client->outLength ? EPOLLOUT : 0), {.ptr = client}};
+    return epoll_ctl(daemon->epollFd, EPOLL_CTL_MOD, client->fd, &event);
+}
+
+// Function to hand a closed client to the end of the event batch, which
+// may still hold events for it
+static void daemonRelease(EepromDaemon *daemon, DaemonClient *client) {
+    client->nextFree = daemon->released;
+    daemon->released = client;
+}
+
+// Function to free the clients released during an event batch
+static void daemonReleased(EepromDaemon *daemon) {
+    while (daemon->released) {
+        DaemonClient *client = daemon->released;
+        daemon->released = client->nextFree;
+        free(client->out);
+        free(client);
+    }
+}
+
+// Function to close a connection; the client is released unless a write is pending
+static void daemonClose(EepromDaemon *daemon, DaemonClient *client) {
+    epoll_ctl(daemon->epollFd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    client->closed = 1;
+    if (!client->waiting) {
+        daemonRelease(daemon, client);
+    }
+}
+
+// Function to answer one request line. Returns -1 to close the connection.
+static int daemonRequest(EepromDaemon *daemon, DaemonClient *client, char *line) {
+    char reply[DAEMON_LINE_MAX];
+    char *save;
+    char *command = strtok_r(line, " \t", &save);
+    char *key = strtok_r(NULL, " \t", &save);
+    int field = key ? eepromFieldForKey(key) : -1;
+
+    if (!command) {
+        return 0;
+    }
+    if (strcmp(command, "get") == 0 && field >= 0) {
+        char value[DAEMON_LINE_MAX - 4]; // Room for "OK " and the newline
+        pthread_mutex_lock(&daemon->lock);
+        eepromFieldFormat(field, daemon->image + eepromLayout->offset[field], value, sizeof(value));
+        pthread_mutex_unlock(&daemon->lock);
+        snprintf(reply, sizeof(reply), "OK %s\n", value);
+        return daemonAppend(client, reply, strlen(reply));
     }
+    if ((strcmp(command, "set") == 0 || strcmp(command, "clear") == 0) && field >= 0) {
+        DaemonRequest *request = calloc(1, sizeof(DaemonRequest));
+        char *value = save + strspn(save, " \t");
+        if (!request) {
+            return -1;
+        }
+        request->client = client;
+        request->field = field;
+        request->clear = command[0] == 'c';
+        snprintf(request->arg, sizeof(request->arg), "%s", value);
+        client->waiting = 1;
 
-    // Read data from EEPROM
-    if (read(file, data, dataSize) != dataSize) {
-        perror("Read failed");
+        pthread_mutex_lock(&daemon->lock);
+        if (daemon->queueHead) {
+            daemon->queueTail->next = request;
+        } else {
+            daemon->queueHead = request;
+        }
+        daemon->queueTail = request;
+        pthread_cond_signal(&daemon->wake);
+        pthread_mutex_unlock(&daemon->lock);
+        return 0;
+    }
+    if (strcmp(command, "dump") == 0) {
+        char *text = NULL;
+        size_t length = 0;
+        FILE *stream = open_memstream(&text, &length);
+        if (!stream) {
+            return -1;
+        }
+        uint64_t metricStart = eepromMetricStart();
+        pthread_mutex_lock(&daemon->lock);
+        HexDumpOptions options = HEXDUMP_DEFAULT_OPTIONS;
+        hexDumpToStream(stream, daemon->image, eepromImageSize, &options);
+        pthread_mutex_unlock(&daemon->lock);
+        eepromMetricRecord(METRIC_DUMP, metricStart, eepromImageSize, 1, 0, 0);
+        fclose(stream);
+        int status = daemonAppend(client, text, length);
+        free(text);
+        return status == 0 ? daemonAppend(client, "OK\n", 3) : -1;
+    }
+    if (strcmp(command, "metrics") == 0) {
+        char *text = NULL;
+        size_t length = 0;
+        FILE *stream = open_memstream(&text, &length);
+        if (!stream) {
+            return -1;
+        }
+        eepromMetricsPrometheus(stream, "eeprom_i2c");
+        fclose(stream);
+        int status = daemonAppend(client, text, length);
+        free(text);
+        return status == 0 ? daemonAppend(client, "OK\n", 3) : -1;
+    }
+    if (strcmp(command, "verify") == 0) {
+        static const char *states[] = {"OK ok\n", "OK blank\n", "OK mismatch\n"};
+        pthread_mutex_lock(&daemon->lock);
+        const char *state = states[daemon->checksumStatus];
+        pthread_mutex_unlock(&daemon->lock);
+        return daemonAppend(client, state, strlen(state));
+    }
+    if (strcmp(command, "quit") == 0) {
         return -1;
     }
+
+    snprintf(reply, sizeof(reply), key && field < 0 ? "ERR unknown key %s\n" : "ERR unknown request\n", key);
+    return daemonAppend(client, reply, strlen(reply));
+}
+
+// Function to answer every complete line a client has sent, up to its next write
+static int daemonProcess(EepromDaemon *daemon, DaemonClient *client) {
+    while (!client->waiting) {
+        char *newline = memchr(client->in, '\n', client->inLength);
+        if (!newline) {
+            if (client->inLength == sizeof(client->in)) {
+                daemonAppend(client, "ERR line too long\n", 18);
+                return -1;
+            }
+            break;
+        }
+        *newline = '\0';
+        if (newline > client->in && newline[-1] == '\r') {
+            newline[-1] = '\0';
+        }
+        size_t consumed = newline + 1 - client->in;
+        int status = daemonRequest(daemon, client, client->in);
+        memmove(client->in, client->in + consumed, client->inLength - consumed);
+        client->inLength -= consumed;
+        if (status != 0) {
+            return -1;
+        }
+    }
+    return daemonFlush(daemon, client);
+}
+
+// Function to deliver the replies of finished writes
+static void daemonCompleted(EepromDaemon *daemon) {
+    uint64_t count;
+    if (read(daemon->eventFd, &count, sizeof(count)) < 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&daemon->lock);
+    DaemonRequest *request = daemon->done;
+    daemon->done = NULL;
+    pthread_mutex_unlock(&daemon->lock);
+
+    while (request) {
+        DaemonRequest *next = request->next;
+        DaemonClient *client = request->client;
+        client->waiting = 0;
+        if (client->closed) {
+            daemonRelease(daemon, client);
+        } else if (daemonAppend(client, request->reply, strlen(request->reply)) != 0 ||
+                   daemonProcess(daemon, client) != 0) {
+            daemonFlush(daemon, client);
+            daemonClose(daemon, client);
+        }
+        free(request);
+        request = next;
+    }
+}
+
+// Function to accept every pending connection
+static void daemonAccept(EepromDaemon *daemon, int listenFd) {
+    for (;;) {
+        int fd = accept(listenFd, NULL, NULL);
+        if (fd < 0) {
+            return;
+        }
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        DaemonClient *client = calloc(1, sizeof(DaemonClient));
+        struct epoll_event event = {EPOLLIN, {.ptr = client}};
+        if (!client || epoll_ctl(daemon->epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            free(client);
+            close(fd);
+            continue;
+        }
+        client->fd = fd;
+    }
+}
+
+// Function to serve requests on a Unix-domain socket until SIGINT or SIGTERM
+int runDaemon(I2cBus *bus, EepromShadow *shadow, const char *shadowPath, const char *socketPath) {
+    static EepromDaemon daemon;
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+
+    // Everything is served from memory, so read and verify the image once
+    if (shadowLoad(bus, shadow, 0, eepromImageSize) != 0) {
+        return 1;
+    }
+    daemon.bus = bus;
+    daemon.shadow = shadow;
+    daemon.shadowPath = shadowPath;
+    daemon.transferMode = transferMode;
+    daemon.eepromAddress = eepromAddress;
+    daemon.selectedSlave = selectedSlave;
+    pthread_mutex_init(&daemon.lock, NULL);
+    pthread_cond_init(&daemon.wake, NULL);
+    daemonPublish(&daemon);
+    eepromFieldMessages = 0;
+    crc32cInit();
+
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socketPath);
+        return 1;
+    }
+    strcpy(address.sun_path, socketPath);
+    unlink(socketPath);
+    int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0 || bind(listenFd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listenFd, SOMAXCONN) != 0) {
+        perror("Failed to listen on daemon socket");
+        return 1;
+    }
+
+    daemon.epollFd = epoll_create1(EPOLL_CLOEXEC);
+    daemon.eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event listenEvent = {EPOLLIN, {.ptr = &listenFd}};
+    struct epoll_event doneEvent = {EPOLLIN, {.ptr = &daemon.eventFd}};
+    if (daemon.epollFd < 0 || daemon.eventFd < 0 ||
+        epoll_ctl(daemon.epollFd, EPOLL_CTL_ADD, listenFd, &listenEvent) != 0 ||
+        epoll_ctl(daemon.epollFd, EPOLL_CTL_ADD, daemon.eventFd, &doneEvent) != 0) {
+        perror("Failed to set up the event loop");
+        return 1;
+    }
+
+    pthread_t writer;
+    if (pthread_create(&writer, NULL, daemonWriter, &daemon) != 0) {
+        perror("Failed to start the writer");
+        return 1;
+    }
+
+    struct sigaction stop = {.sa_handler = daemonSignal};
+    sigaction(SIGINT, &stop, NULL);
+    sigaction(SIGTERM, &stop, NULL);
+    printf("Serving %s on %s\n", eepromLayout->name, socketPath);
+    fflush(stdout);
+
+    struct epoll_event events[DAEMON_MAX_EVENTS];
+    while (!daemonStop) {
+        int count = epoll_wait(daemon.epollFd, events, DAEMON_MAX_EVENTS, -1);
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.ptr == &listenFd) {
+                daemonAccept(&daemon, listenFd);
+                continue;
+            }
+            if (events[i].data.ptr == &daemon.eventFd) {
+                daemonCompleted(&daemon);
+                continue;
+            }
+
+            DaemonClient *client = events[i].data.ptr;
+            if (client->closed) {
+                continue;
+            }
+            if (events[i].events & EPOLLIN) {
+                ssize_t got = read(client->fd, client->in + client->inLength, sizeof(client->in) - client->inLength);
+                if (got == 0 || (got < 0 && errno != EAGAIN)) {
+                    daemonClose(&daemon, client);
+                    continue;
+                }
+                if (got > 0) {
+                    client->inLength += got;
+                }
+            }
+            if (daemonProcess(&daemon, client) != 0) {
+                daemonFlush(&daemon, client);
+                daemonClose(&daemon, client);
+            }
+        }
+        daemonReleased(&daemon);
+    }
+
+    // Finish queued writes before the bus is closed
+    pthread_mutex_lock(&daemon.lock);
+    daemon.stopping = 1;
+    pthread_cond_signal(&daemon.wake);
+    pthread_mutex_unlock(&daemon.lock);
+    pthread_join(writer, NULL);
+    writeStats = daemon.writeStats;
+    readStats.bytes += daemon.readStats.bytes;
+    readStats.transactions += daemon.readStats.transactions;
+    close(listenFd);
+    unlink(socketPath);
     return 0;
 }
 
+// Options handled by this tool in addition to the generated field options
+static const struct option toolOptions[] = {
+    {"part", required_argument, 0, 'P'},
+    {"pageSize", required_argument, 0, 'g'},
+    {"maxXfer", required_argument, 0, 'x'},
+    {"smbus", no_argument, 0, 'S'},
+    {"shadow", required_argument, 0, 'w'},
+    {"layout", required_argument, 0, 'L'},
+    {"verify", no_argument, 0, 'V'},
+    {"fleet", required_argument, 0, 'F'},
+    {"bus", required_argument, 0, 'B'},
+    {"address", required_argument, 0, 'A'},
+    {"macPool", required_argument, 0, 'K'},
+    {"macPoolInit", required_argument, 0, 'I'},
+    {"daemon", required_argument, 0, 'D'},
+    {"logSet", required_argument, 0, 'U'},
+    {"logGet", required_argument, 0, 'G'},
+    {"logList", no_argument, 0, 'T'},
+    {"metrics", required_argument, 0, 'X'},
+    {"dump", required_argument, 0, 'E'},
+    {"restore", required_argument, 0, 'R'},
+    {0, 0, 0, 0}
+};
+static const char toolShortOptions[] = "P:g:x:Sw:L:VF:B:A:K:I:D:U:G:TX:E:R:";
+
 int main(int argc, char *argv[]) {
     int option;
-    const struct option long_options[] = {
-        {"updSRNUM", required_argument, 0, 's'},
-        {"updBSRNUM", required_argument, 0, 'b'},
-        {"updMACID", required_argument, 0, 'm'},
-        {"clearSRNUM", no_argument, 0, 'c'},
-        {"clearBSRNUM", no_argument, 0, 'd'},
-        {"clearMACID", no_argument, 0, 'n'},
-        {"updRD", required_argument, 0, 'r'},
-        {0, 0, 0, 0}
-    };
-
-    // Open the I2C bus
-    int i2cFile = open(I2C_BUS, O_RDWR);
-    if (i2cFile < 0) {
+    struct option long_options[FIELD_COUNT * 2 + sizeof(toolOptions) / sizeof(toolOptions[0]) + 1];
+    char shortOptions[sizeof(toolShortOptions) + EEPROM_FIELD_SHORT_OPTIONS];
+    memcpy(shortOptions, toolShortOptions, sizeof(toolShortOptions));
+    int fieldOptionCount = eepromFieldOptions(long_options, shortOptions);
+    memcpy(long_options + fieldOptionCount, toolOptions, sizeof(toolOptions));
+
+    // Select the part before any option touches the device
+    const EepromPart *part = findEepromPart(EEPROM_DEFAULT_PART);
+    int pageSizeOverride = 0;
+    int forceSmbus = 0;
+    const char *shadowPath = NULL;
+    const char *fleetPath = NULL;
+    const char *busPath = I2C_BUS;
+    unsigned short deviceAddress = EEPROM_I2C_ADDRESS;
+    const char *macPoolPath = NULL;
+    const char *macPoolRange = NULL;
+    const char *daemonPath = NULL;
+    const char *metricsPath = NULL;
+    const char *dumpPath = NULL;
+    const char *restorePath = NULL;
+    opterr = 0;
+    while ((option = getopt_long_only(argc, argv, shortOptions, long_options, NULL)) != -1) {
+        if (option == 'P') {
+            part = findEepromPart(optarg);
+            if (part == NULL) {
+                printf("Unknown part %s.\n", optarg);
+                return 1;
+            }
+        } else if (option == 'g') {
+            pageSizeOverride = atoi(optarg);
+            if (pageSizeOverride < 8 || pageSizeOverride > EEPROM_MAX_PAGE_SIZE || (pageSizeOverride & (pageSizeOverride - 1)) != 0) {
+                printf("Invalid page size. Must be 8, 16, 32, 64, 128 or 256.\n");
+                return 1;
+            }
+        } else if (option == 'x') {
+            int maxXfer = atoi(optarg);
+            if (maxXfer < 1 || maxXfer > I2C_DEV_MAX_TRANSFER) {
+                printf("Invalid transfer size. Must be between 1 and %d.\n", I2C_DEV_MAX_TRANSFER);
+                return 1;
+            }
+            maxTransferSize = maxXfer;
+        } else if (option == 'S') {
+            forceSmbus = 1;
+        } else if (option == 'w') {
+            shadowPath = optarg;
+        } else if (option == 'L') {
+            eepromLayout = findEepromLayout(optarg);
+            if (eepromLayout == NULL) {
+                printf("Unknown layout %s.\n", optarg);
+                return 1;
+            }
+        } else if (option == 'F') {
+            fleetPath = optarg;
+        } else if (option == 'B') {
+            busPath = optarg;
+        } else if (option == 'D') {
+            daemonPath = optarg;
+        } else if (option == 'X') {
+            metricsPath = optarg;
+            eepromMetricsEnabled = 1;
+        } else if (option == 'E') {
+            dumpPath = optarg;
+        } else if (option == 'R') {
+            restorePath = optarg;
+        } else if (option == 'K') {
+            macPoolPath = optarg;
+        } else if (option == 'I') {
+            macPoolRange = optarg;
+        } else if (option == 'A') {
+            long address = strtol(optarg, NULL, 0);
+            if (address < 0x03 || address > 0x77) {
+                printf("Invalid device address. Must be between 0x03 and 0x77.\n");
+                return 1;
+            }
+            deviceAddress = address;
+        }
+    }
+    eepromPageSize = pageSizeOverride ? (unsigned int)pageSizeOverride : part->pageSize;
+    eepromAddressBytes = part->addressBytes;
+    eepromPartSize = part->size;
+    eepromImageSize = part->size < EEPROM_SIZE ? part->size : EEPROM_SIZE;
+    if (eepromLayout->end > part->size) {
+        printf("Layout %s needs %u bytes, the %s has %u.\n", eepromLayout->name, eepromLayout->end, part->name, part->size);
+        return 1;
+    }
+    optind = 0;
+    opterr = 1;
+
+    // MAC ID counts are allocated from the shared pool
+    static MacPool macPool;
+    if (macPoolRange && !macPoolPath) {
+        printf("--macPoolInit needs --macPool <file>.\n");
+        return 1;
+    }
+    if (macPoolPath) {
+        if (macPoolSetup(&macPool, macPoolPath, macPoolRange) != 0) {
+            return 1;
+        }
+        eepromMacPool = &macPool;
+    }
+
+    // Fleet mode programs the devices listed in the job file and exits
+    if (fleetPath) {
+        int status = runFleet(fleetPath, part, forceSmbus);
+        if (metricsPath && eepromMetricsWrite(metricsPath, "eeprom_i2c") != 0) {
+            status = 1;
+        }
+        return status;
+    }
+
+    // Open the I2C bus, or the simulated one
+    I2cBus bus;
+    if (openEEPROMBus(&bus, busPath, part) != 0) {
         perror("Failed to open the I2C bus");
         return 1;
     }
 
     // Set the I2C address of the EEPROM
-    if (ioctl(i2cFile, I2C_SLAVE, EEPROM_I2C_ADDRESS) < 0) {
+    if (selectEEPROMDevice(&bus, deviceAddress) != 0) {
         perror("Failed to acquire bus access and/or talk to slave");
+        i2cClose(&bus);
+        return 1;
+    }
+
+    // Choose between I2C_RDWR and SMBus transfers
+    if (detectAdapter(&bus, forceSmbus) != 0) {
+        i2cClose(&bus);
+        return 1;
+    }
+
+    // Streaming dump and restore cover the whole part and bypass the shadow
+    if (dumpPath || restorePath) {
+        int status = dumpPath ? dumpEEPROM(&bus, dumpPath) : restoreEEPROM(&bus, restorePath);
+        if (restorePath && writeStats.pages > 0 && shadowPath) {
+            // The saved shadow no longer matches the device
+            unlink(shadowPath);
+        }
+        printWriteStats();
+        i2cClose(&bus);
+        if (metricsPath && eepromMetricsWrite(metricsPath, "eeprom_i2c") != 0) {
+            status = 1;
+        }
+        return status;
+    }
+
+    // All reads are served from the shadow image
+    static EepromShadow shadow;
+    char *eepromData = shadow.data;
+    if (shadowPath && shadowRestore(&bus, &shadow, shadowPath) != 0) {
+        i2cClose(&bus);
         return 1;
     }
 
-    char eepromData[EEPROM_SIZE];
+    // Daemon mode serves socket requests from the shadow until stopped
+    if (daemonPath) {
+        int status = runDaemon(&bus, &shadow, shadowPath, daemonPath);
+        printWriteStats();
+        i2cClose(&bus);
+        if (metricsPath && eepromMetricsWrite(metricsPath, "eeprom_i2c") != 0) {
+            status = 1;
+        }
+        return status;
+    }
+
+    char fieldData[EEPROM_LAYOUT_LIMIT];
+    int clear;
+    int status = 0;
+
+    // The record log is scanned on first use
+    static EepromLog recordLog;
+    int logScanned = 0;
+    ShadowLogTarget logTarget = {&bus, &shadow};
+    int logKey;
+    uint64_t logValue;
+
+    while ((option = getopt_long_only(argc, argv, shortOptions, long_options, NULL)) != -1) {
+        // Update and clear options are generated from the field table
+        int field = eepromFieldForOption(option, &clear);
+        if (field >= 0) {
+            unsigned int offset = eepromLayout->offset[field];
+            int length = clear ? (int)eepromFields[field].length : eepromFieldEncode(field, optarg, fieldData);
+            if (length <= 0) {
+                status = 1;
+                continue;
+            }
+            if (clear) {
+                eepromFieldCleared(field);
+            }
+
+            // Write changed bytes to EEPROM
+            if (shadowUpdate(&bus, &shadow, offset, clear ? NULL : fieldData, 0, length) == 0) {
+                printf("Data written to EEPROM.\n");
+            }
+            printShadowDump(&bus, &shadow);
+            continue;
+        }
 
-    while ((option = getopt_long_only(argc, argv, "s:b:m:cdnr:", long_options, NULL)) != -1) {
         switch (option) {
-            case 's':
-                // Update Serial Number
-                if (strlen(optarg) == SERIAL_NUMBER_LENGTH) {
-                    strncpy(eepromData + SERIAL_NUMBER_OFFSET, optarg, SERIAL_NUMBER_LENGTH);
-                    printf("Serial Number updated successfully: %s\n", optarg);
-                    printHexDump(eepromData, sizeof(eepromData));
-
-                    // Write updated data to EEPROM
-                    if (writeDataToEEPROM(i2cFile, SERIAL_NUMBER_OFFSET, eepromData + SERIAL_NUMBER_OFFSET, SERIAL_NUMBER_LENGTH) == 0) {
-                        printf("Data written to EEPROM.\n");
-                    }
-                } else {
-                    printf("Serial Number has an incorrect length.\n");
+            case 'r':
+                // Read parameter from the shadow image
+                field = eepromFieldForKey(optarg);
+                if (field < 0) {
+                    printf("Invalid argument for -updRD.\n");
+                } else if (shadowLoad(&bus, &shadow, eepromLayout->offset[field], eepromFields[field].length) == 0) {
+                    eepromFieldPrint(field, eepromData + eepromLayout->offset[field]);
                 }
                 break;
-            case 'b':
-                // Update Board Serial Number
-                if (strlen(optarg) == PCB_SERIAL_NUMBER_LEN) {
-                    strncpy(eepromData + PCB_SERIAL_NUMBER_OFFSET, optarg, PCB_SERIAL_NUMBER_LEN);
-                    printf("Board Serial Number updated successfully: %s\n", optarg);
-                    printHexDump(eepromData, sizeof(eepromData));
-
-                    // Write updated data to EEPROM
-                    if (writeDataToEEPROM(i2cFile, PCB_SERIAL_NUMBER_OFFSET, eepromData + PCB_SERIAL_NUMBER_OFFSET, PCB_SERIAL_NUMBER_LEN) == 0) {
-                        printf("Data written to EEPROM.\n");
-                    }
+            case 'V':
+                // Verify the parameter block checksum
+                if (shadowLoad(&bus, &shadow, PARAMETER_REGION_OFFSET, PARAMETER_REGION_END - PARAMETER_REGION_OFFSET) != 0) {
+                    status = 1;
+                } else if (shadow.checksumStatus == CHECKSUM_BAD) {
+                    printf("Checksum mismatch.\n");
+                    status = 2;
                 } else {
-                    printf("Board Serial Number has an incorrect length.\n");
+                    printf(shadow.checksumStatus == CHECKSUM_BLANK ? "Checksum: blank parameter block.\n" : "Checksum OK.\n");
                 }
                 break;
-            case 'm':
-                // Update MAC IDs
-                if (optarg[0] >= '0' && optarg[0] <= '9') {
-                    int macIdCount = atoi(optarg);
-                    if (macIdCount >= 1 && macIdCount <= MAC_ID_COUNT) {
-                        char macId[MAC_ID_LEN + 1];
-                        for (int i = 0; i < macIdCount; i++) {
-                            snprintf(macId, sizeof(macId), "A0:FC:72:00:53:%02X", i + 1);
-                            strncpy(eepromData + MAC_ID_OFFSET + i * MAC_ID_LEN, macId, MAC_ID_LEN);
-                            printf("MAC ID %d updated successfully: %s\n", i + 1, macId);
-                            printHexDump(eepromData, sizeof(eepromData));
-                        }
-
-                        // Write updated data to EEPROM
-                        if (writeDataToEEPROM(i2cFile, MAC_ID_OFFSET, eepromData + MAC_ID_OFFSET, MAC_ID_COUNT * MAC_ID_LEN) == 0) {
-                            printf("Data written to EEPROM.\n");
-                        }
-                    } else {
-                        printf("Invalid number of MAC IDs. Must be between 1 and %d.\n", MAC_ID_COUNT);
+            case 'U':
+            case 'G':
+            case 'T':
+                // Record log options share one scan of the log area
+                if (!logScanned) {
+                    if (shadowLogScan(&bus, &shadow, &recordLog) != 0) {
+                        status = 1;
+                        break;
                     }
-                } else {
-                    printf("Invalid argument for -updMACID.\n");
-                }
-                break;
-            case 'c':
-                // Clear Serial Number
-                memset(eepromData + SERIAL_NUMBER_OFFSET, 0, SERIAL_NUMBER_LENGTH);
-                printf("Serial Number cleared.\n");
-
-                // Write cleared data to EEPROM
-                if (writeDataToEEPROM(i2cFile, SERIAL_NUMBER_OFFSET, eepromData + SERIAL_NUMBER_OFFSET, SERIAL_NUMBER_LENGTH) == 0) {
-                    printf("Data written to EEPROM.\n");
-                }
-                printHexDump(eepromData, sizeof(eepromData));
-                break;
-            case 'd':
-                // Clear Board Serial Number
-                memset(eepromData + PCB_SERIAL_NUMBER_OFFSET, 0, PCB_SERIAL_NUMBER_LEN);
-                printf("Board Serial Number cleared.\n");
-
-                // Write cleared data to EEPROM
-                if (writeDataToEEPROM(i2cFile, PCB_SERIAL_NUMBER_OFFSET, eepromData + PCB_SERIAL_NUMBER_OFFSET, PCB_SERIAL_NUMBER_LEN) == 0) {
-                    printf("Data written to EEPROM.\n");
+                    logScanned = 1;
                 }
-                break;
-            case 'n':
-                // Clear MAC IDs
-                memset(eepromData + MAC_ID_OFFSET, 0, MAC_ID_COUNT * MAC_ID_LEN);
-                printf("MAC IDs cleared.\n");
-
-                // Write cleared data to EEPROM
-                if (writeDataToEEPROM(i2cFile, MAC_ID_OFFSET, eepromData + MAC_ID_OFFSET, MAC_ID_COUNT * MAC_ID_LEN) == 0) {
-                    printf("Data written to EEPROM.\n");
-                }
-                break;
-            case 'r':
-                // Read parameter
-                if (strcmp(optarg, "SRNUM") == 0) {
-                    // Read data from EEPROM
-                    if (readDataFromEEPROM(i2cFile, SERIAL_NUMBER_OFFSET, eepromData + SERIAL_NUMBER_OFFSET, SERIAL_NUMBER_LENGTH) == 0) {
-                        printf("Serial Number: %s\n", eepromData + SERIAL_NUMBER_OFFSET);
-                    }
-                } else if (strcmp(optarg, "BSRNUM") == 0) {
-                    // Read data from EEPROM
-                    if (readDataFromEEPROM(i2cFile, PCB_SERIAL_NUMBER_OFFSET, eepromData + PCB_SERIAL_NUMBER_OFFSET, PCB_SERIAL_NUMBER_LEN) == 0) {
-                        printf("Board Serial Number: %s\n", eepromData + PCB_SERIAL_NUMBER_OFFSET);
-                    }
-                } else if (strcmp(optarg, "MACID") == 0) {
-                    // Read data from EEPROM
-                    if (readDataFromEEPROM(i2cFile, MAC_ID_OFFSET, eepromData + MAC_ID_OFFSET, MAC_ID_COUNT * MAC_ID_LEN) == 0) {
-                        for (int i = 0; i < MAC_ID_COUNT; i++) {
-                            char macId[MAC_ID_LEN + 1];
-                            strncpy(macId, eepromData + MAC_ID_OFFSET + i * MAC_ID_LEN, MAC_ID_LEN);
-                            macId[MAC_ID_LEN] = '\0';
-                            printf("MAC ID %d: %s\n", i + 1, macId);
-                        }
+                if (option == 'T') {
+                    eepromLogPrint(&recordLog, eepromData);
+                } else if (option == 'G') {
+                    logKey = atoi(optarg);
+                    if (eepromLogGet(&recordLog, eepromData, logKey, &logValue) == 0) {
+                        printf("Log %d: %llu\n", logKey, (unsigned long long)logValue);
+                    } else {
+                        printf("Log %d: not set\n", logKey);
                     }
-                } else {
-                    printf("Invalid argument for -updRD.\n");
+                } else if (eepromLogParse(optarg, &logKey, &logValue) != 0) {
+                    printf("Invalid argument for --logSet. Use <key>=<value>.\n");
+                    status = 1;
+                } else if (eepromPageSize < EEPROM_LOG_SLOT) {
+                    // A record split over two page writes could be torn by a power loss
+                    printf("--logSet needs pages of at least %d bytes, this part has %u.\n", EEPROM_LOG_SLOT, eepromPageSize);
+                    status = 1;
+                } else if (eepromLogSet(&recordLog, eepromData, logKey, logValue, shadowLogWrite, &logTarget) != 0) {
+                    status = 1;
                 }
                 break;
+            case 'P':
+            case 'g':
+            case 'x':
+            case 'S':
+            case 'w':
+            case 'L':
+            case 'F':
+            case 'B':
+            case 'A':
+            case 'K':
+            case 'I':
+            case 'D':
+            case 'X':
+            case 'E':
+            case 'R':
+                // Part, adapter and layout selection handled before processing
+                break;
             default:
                 // Print usage information for unknown options
-                printf("Usage: %s --updSRNUM <new_serial_number> --updBSRNUM <new_board_serial_number> --updMACID <num_of_macids> --clearSRNUM --clearBSRNUM --clearMACID --updRD <parameter>\n", argv[0]);
+                printf("Usage: %s --updSRNUM <new_serial_number> --updBSRNUM <new_board_serial_number> --updPID <new_product_id> --updMACID <num_of_macids> --clearSRNUM --clearBSRNUM --clearPID --clearMACID --updRD <parameter> --layout <name> --part <name> --pageSize <bytes> --maxXfer <bytes> --smbus --shadow <file> --verify --fleet <file> --bus <path> --address <addr> --macPool <file> --macPoolInit <range> --daemon <socket> --logSet <key>=<value> --logGet <key> --logList --metrics <file> --dump <file> --restore <file>\n", argv[0]);
                 break;
         }
     }
 
+    if (recordLog.compactions > 0) {
+        printf("Log area compacted %lu time(s).\n", recordLog.compactions);
+    }
+    if (shadowFinish(&bus, &shadow, shadowPath) != 0) {
+        status = 1;
+    }
+    printWriteStats();
+
     // Close the I2C bus
-    close(i2cFile);
+    i2cClose(&bus);
 
-    return 0;
+    // Export the per-operation counters
+    if (metricsPath && eepromMetricsWrite(metricsPath, "eeprom_i2c") != 0) {
+        status = 1;
+    }
+
+    return status;
 }
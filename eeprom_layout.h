@@ -0,0 +1,439 @@
+#ifndef EEPROM_LAYOUT_H
+#define EEPROM_LAYOUT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <getopt.h>
+
+#include "eeprom_crc32c.h"
+#include "eeprom_macpool.h"
+
+// Parameter layout shared by both tools.
+//
+// Every parameter is described once in EEPROM_FIELDS. Each board layout
+// only places the fields at offsets; overlaps and fields past the end of
+// the smallest supported image are rejected at compile time. Options,
+// update, clear and read handlers are all generated from these tables.
+// The last field of every layout is a CRC32C over all fields before it.
+
+// Define your data types here
+typedef char RJS8T;
+typedef unsigned char RJU8T;
+typedef signed short RJS16T;
+typedef unsigned short RJU16T;
+typedef signed int RJS32T;
+typedef unsigned int RJU32T;
+
+// Every layout must fit in an image of this size
+#define EEPROM_LAYOUT_LIMIT 1024
+
+// MAC IDs are stored as MAC_ID_COUNT slots of MAC_ID_LENGTH bytes, each a
+// binary address in network byte order
+#define MAC_ID_LENGTH 6
+#define MAC_ID_COUNT 3
+
+// Field encodings
+#define FIELD_TEXT 0  // Fixed-length printable ASCII, exact length required
+#define FIELD_MAC 1   // MAC_ID_COUNT MAC ID slots, argument is a count or a base address
+#define FIELD_STAMP 2 // Maintained by the tools, not set from the command line
+
+// X(id, label, key, length, encoding, update option, clear option)
+// The key names the options: --upd<key>, --clear<key> and --updRD <key>.
+#define EEPROM_FIELDS(X) \
+    X(SERIAL_NUMBER,     "Serial Number",       "SRNUM",  18,                           FIELD_TEXT,  's', 'c') \
+    X(PCB_SERIAL_NUMBER, "Board Serial Number", "BSRNUM", 18,                           FIELD_TEXT,  'b', 'd') \
+    X(PRODUCT_ID,        "Product ID",          "PID",    12,                           FIELD_TEXT,  'p', 'e') \
+    X(MAC_ID,            "MAC ID",              "MACID",  MAC_ID_COUNT * MAC_ID_LENGTH, FIELD_MAC,   'm', 'n') \
+    X(GENERATION,        "Generation",          "GEN",    4,                            FIELD_STAMP, 0,   0)   \
+    X(CHECKSUM,          "Checksum",            "CRC",    4,                            FIELD_STAMP, 0,   0)
+
+// Board layouts: X(layout, field, offset), listed in address order.
+// SIM is the simulated image used by EEPROMTOOL. ODSC5G is the ODSC 5G
+// board programmed over I2C, with every field at the offset existing
+// boards already have it.
+#define EEPROM_LAYOUT_SIM(X, L) \
+    X(L, SERIAL_NUMBER, 0) \
+    X(L, PCB_SERIAL_NUMBER, 18) \
+    X(L, PRODUCT_ID, 36) \
+    X(L, MAC_ID, 48) \
+    X(L, GENERATION, 66) \
+    X(L, CHECKSUM, 70)
+
+#define EEPROM_LAYOUT_ODSC5G(X, L) \
+    X(L, SERIAL_NUMBER, 100) \
+    X(L, PCB_SERIAL_NUMBER, 118) \
+    X(L, PRODUCT_ID, 136) \
+    X(L, MAC_ID, 148) \
+    X(L, GENERATION, 166) \
+    X(L, CHECKSUM, 170)
+
+#define EEPROM_LAYOUTS(X) \
+    X(SIM, "sim", EEPROM_LAYOUT_SIM) \
+    X(ODSC5G, "odsc5g", EEPROM_LAYOUT_ODSC5G)
+
+// Field ids and lengths
+#define FIELD_ENUM(id, label, key, length, encoding, upd, clr) FIELD_##id,
+enum { EEPROM_FIELDS(FIELD_ENUM) FIELD_COUNT };
+#undef FIELD_ENUM
+
+#define FIELD_LENGTH_ENUM(id, label, key, length, encoding, upd, clr) FIELD_LENGTH_##id = (length),
+enum { EEPROM_FIELDS(FIELD_LENGTH_ENUM) };
+#undef FIELD_LENGTH_ENUM
+
+// Compile-time layout checks. For every field the enumerator before it is
+// the end of the previous field, so the implicit "+1" value right after it
+// tells whether the field starts at or after that end.
+#define LAYOUT_BOUNDS(L, id, offset) \
+    LAYOUT_##L##_##id##_PREV_END_PLUS1, \
+    LAYOUT_##L##_##id##_END = (offset) + FIELD_LENGTH_##id,
+
+#define LAYOUT_ASSERTS(L, id, offset) \
+    _Static_assert((offset) + 1 >= LAYOUT_##L##_##id##_PREV_END_PLUS1, #L " layout: " #id " overlaps the previous field"); \
+    _Static_assert((offset) + FIELD_LENGTH_##id <= EEPROM_LAYOUT_LIMIT, #L " layout: " #id " is out of range");
+
+#define LAYOUT_COUNT_ENTRY(L, id, offset) LAYOUT_##L##_COUNT_##id,
+
+#define LAYOUT_DECLARE(L, name, fields) \
+    enum { LAYOUT_##L##_BEGIN = 0, fields(LAYOUT_BOUNDS, L) LAYOUT_##L##_END_PLUS1 }; \
+    enum { fields(LAYOUT_COUNT_ENTRY, L) LAYOUT_##L##_FIELD_COUNT }; \
+    fields(LAYOUT_ASSERTS, L) \
+    _Static_assert((int)LAYOUT_##L##_FIELD_COUNT == (int)FIELD_COUNT, #L " layout must place every field"); \
+    _Static_assert((int)LAYOUT_##L##_CHECKSUM_END == (int)LAYOUT_##L##_END_PLUS1 - 1, #L " layout must end with the checksum");
+
+EEPROM_LAYOUTS(LAYOUT_DECLARE)
+
+typedef struct {
+    const char *label;
+    const char *key;
+    unsigned int length;
+    int encoding;
+    char updateOption;
+    char clearOption;
+} EepromFieldInfo;
+
+typedef struct {
+    const char *name;
+    unsigned int end; // End of the last field, the smallest usable image size
+    unsigned int offset[FIELD_COUNT];
+} EepromLayout;
+
+#define FIELD_INFO(id, label, key, length, encoding, upd, clr) {label, key, (length), encoding, upd, clr},
+static const EepromFieldInfo eepromFields[FIELD_COUNT] = { EEPROM_FIELDS(FIELD_INFO) };
+#undef FIELD_INFO
+
+#define LAYOUT_OFFSET(L, id, offset) [FIELD_##id] = (offset),
+#define LAYOUT_ENTRY(L, name, fields) {name, LAYOUT_##L##_END_PLUS1 - 1, { fields(LAYOUT_OFFSET, L) }},
+static const EepromLayout eepromLayouts[] = { EEPROM_LAYOUTS(LAYOUT_ENTRY) };
+#undef LAYOUT_ENTRY
+#undef LAYOUT_OFFSET
+
+#define LAYOUT_INDEX(L, name, fields) EEPROM_LAYOUT_INDEX_##L,
+enum { EEPROM_LAYOUTS(LAYOUT_INDEX) EEPROM_LAYOUT_COUNT };
+#undef LAYOUT_INDEX
+
+// Build-time default layout, e.g. -DEEPROM_LAYOUT=ODSC5G. Each tool
+// defines its own default before including this header.
+#ifndef EEPROM_LAYOUT
+#define EEPROM_LAYOUT SIM
+#endif
+#define EEPROM_LAYOUT_INDEX_EXPAND(L) EEPROM_LAYOUT_INDEX_##L
+#define EEPROM_LAYOUT_INDEX(L) EEPROM_LAYOUT_INDEX_EXPAND(L)
+#define EEPROM_DEFAULT_LAYOUT (&eepromLayouts[EEPROM_LAYOUT_INDEX(EEPROM_LAYOUT)])
+
+// Option character of --updRD
+#define EEPROM_READ_OPTION 'r'
+
+// Characters eepromFieldOptions appends to a short option string:
+// "x:y" per settable field, then "r:"
+#define EEPROM_FIELD_SHORT_OPTIONS (FIELD_COUNT * 3 + 2)
+
+// Function to look up a layout by name, returns NULL if unknown
+static inline const EepromLayout *findEepromLayout(const char *name) {
+    for (int i = 0; i < EEPROM_LAYOUT_COUNT; i++) {
+        if (strcmp(eepromLayouts[i].name, name) == 0) {
+            return &eepromLayouts[i];
+        }
+    }
+    return NULL;
+}
+
+// Function to find the start of the first field of a layout
+static inline unsigned int eepromLayoutBegin(const EepromLayout *layout) {
+    unsigned int begin = layout->end;
+
+    for (int id = 0; id < FIELD_COUNT; id++) {
+        if (layout->offset[id] < begin) {
+            begin = layout->offset[id];
+        }
+    }
+    return begin;
+}
+
+// Result of checking the parameter block checksum
+#define CHECKSUM_OK 0
+#define CHECKSUM_BLANK 1 // Never programmed: all 0x00 or all 0xFF
+#define CHECKSUM_BAD 2
+
+// Function to read a little-endian 32-bit value from the image
+static inline uint32_t eepromGetU32(const char *data) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+// Function to store a little-endian 32-bit value into a buffer
+static inline void eepromPutU32(char *data, uint32_t value) {
+    data[0] = value & 0xFF;
+    data[1] = (value >> 8) & 0xFF;
+    data[2] = (value >> 16) & 0xFF;
+    data[3] = (value >> 24) & 0xFF;
+}
+
+// Function to get the length of the block covered by the checksum,
+// which runs from the first field up to the checksum itself
+static inline unsigned int eepromChecksumLength(const EepromLayout *layout) {
+    return layout->offset[FIELD_CHECKSUM] - eepromLayoutBegin(layout);
+}
+
+// Function to compute the checksum of the parameter block of an image
+static inline uint32_t eepromChecksumCompute(const EepromLayout *layout, const char *image) {
+    return crc32c(image + eepromLayoutBegin(layout), eepromChecksumLength(layout));
+}
+
+// Function to verify the parameter block of an image against its checksum
+static inline int eepromChecksumVerify(const EepromLayout *layout, const char *image, uint32_t *computed) {
+    unsigned int begin = eepromLayoutBegin(layout);
+    const char *block = image + begin;
+
+    *computed = eepromChecksumCompute(layout, image);
+    if (*computed == eepromGetU32(image + layout->offset[FIELD_CHECKSUM])) {
+        return CHECKSUM_OK;
+    }
+
+    int blank = 1;
+    for (unsigned int i = 1; i < layout->end - begin && blank; i++) {
+        blank = block[i] == block[0];
+    }
+    if (blank && (block[0] == 0 || (unsigned char)block[0] == 0xFF)) {
+        return CHECKSUM_BLANK;
+    }
+    return CHECKSUM_BAD;
+}
+
+// Function to update a checksum after bytes at offset changed from oldData to newData
+static inline uint32_t eepromChecksumPatch(const EepromLayout *layout, uint32_t crc, unsigned int offset,
+                                           const char *oldData, const char *newData, unsigned int length) {
+    unsigned int begin = eepromLayoutBegin(layout);
+
+    return crc32cPatch(crc, eepromChecksumLength(layout), offset - begin, oldData, newData, length);
+}
+
+// Function to fill getopt tables with the field options.
+// Returns the number of long options written; the short option string
+// is appended to shortOptions, which needs room for
+// EEPROM_FIELD_SHORT_OPTIONS more characters.
+static inline int eepromFieldOptions(struct option *options, char *shortOptions) {
+    int count = 0;
+    char *shortEnd = shortOptions + strlen(shortOptions);
+    static char names[FIELD_COUNT * 2][32];
+
+    for (int id = 0; id < FIELD_COUNT; id++) {
+        const EepromFieldInfo *field = &eepromFields[id];
+        if (field->encoding == FIELD_STAMP) {
+            continue;
+        }
+        snprintf(names[id * 2], sizeof(names[0]), "upd%s", field->key);
+        snprintf(names[id * 2 + 1], sizeof(names[0]), "clear%s", field->key);
+        options[count++] = (struct option){names[id * 2], required_argument, 0, field->updateOption};
+        options[count++] = (struct option){names[id * 2 + 1], no_argument, 0, field->clearOption};
+        *shortEnd++ = field->updateOption;
+        *shortEnd++ = ':';
+        *shortEnd++ = field->clearOption;
+    }
+    options[count++] = (struct option){"updRD", required_argument, 0, EEPROM_READ_OPTION};
+    *shortEnd++ = EEPROM_READ_OPTION;
+    *shortEnd++ = ':';
+    *shortEnd = '\0';
+    return count;
+}
+
+// Function to map an option character to a field.
+// Returns the field id or -1; *clear tells update from clear.
+static inline int eepromFieldForOption(int option, int *clear) {
+    for (int id = 0; id < FIELD_COUNT; id++) {
+        if (eepromFields[id].encoding == FIELD_STAMP) {
+            continue;
+        }
+        if (option == eepromFields[id].updateOption || option == eepromFields[id].clearOption) {
+            *clear = option == eepromFields[id].clearOption;
+            return id;
+        }
+    }
+    return -1;
+}
+
+// Function to map an --updRD key to a field, returns -1 if unknown
+static inline int eepromFieldForKey(const char *key) {
+    for (int id = 0; id < FIELD_COUNT; id++) {
+        if (eepromFields[id].encoding != FIELD_STAMP && strcmp(eepromFields[id].key, key) == 0) {
+            return id;
+        }
+    }
+    return -1;
+}
+
+// Print a confirmation for every encoded field; batch modes turn this off
+static int eepromFieldMessages = 1;
+
+// Pool that MAC ID counts are allocated from, NULL until --macPool is given
+static MacPool *eepromMacPool;
+
+// Function to validate an update argument and encode the new field bytes.
+// Returns the number of bytes to write from the start of the field, or -1
+// after printing why the argument was rejected.
+static inline int eepromFieldEncode(int id, const char *arg, char *out) {
+    const EepromFieldInfo *field = &eepromFields[id];
+
+    if (field->encoding == FIELD_TEXT) {
+        if (strlen(arg) != field->length) {
+            printf("%s has an incorrect length.\n", field->label);
+            return -1;
+        }
+        for (unsigned int i = 0; i < field->length; i++) {
+            if (arg[i] < 32 || arg[i] > 126) {
+                printf("%s contains a non-printable character.\n", field->label);
+                return -1;
+            }
+        }
+        memcpy(out, arg, field->length);
+        if (eepromFieldMessages) {
+            printf("%s updated successfully: %s\n", field->label, arg);
+        }
+        return field->length;
+    }
+
+    // Either <base>[/<count>] given explicitly, or <count> taken from the
+    // pool, or from the default block when no pool is open
+    uint64_t base;
+    const char *end;
+    int macIdCount = MAC_ID_COUNT;
+    int fromPool = 0;
+    if (macParse(arg, &base, &end) == 6) {
+        if (*end == '/') {
+            macIdCount = (end[1] >= '0' && end[1] <= '9') ? atoi(end + 1) : 0;
+        } else if (*end != '\0') {
+            macIdCount = 0;
+        }
+    } else if (arg[0] >= '0' && arg[0] <= '9') {
+        macIdCount = atoi(arg);
+        fromPool = 1;
+    } else {
+        printf("Invalid argument for -upd%s.\n", field->key);
+        return -1;
+    }
+    if (macIdCount < 1 || macIdCount > MAC_ID_COUNT) {
+        printf("Invalid number of MAC IDs. Must be between 1 and %d.\n", MAC_ID_COUNT);
+        return -1;
+    }
+
+    if (fromPool && !eepromMacPool) {
+        base = MAC_DEFAULT_BASE;
+    } else if (fromPool) {
+        if (macPoolAllocate(eepromMacPool, macIdCount, &base) != 0) {
+            printf("MAC pool exhausted.\n");
+            return -1;
+        }
+    } else if (base + macIdCount > MAC_ADDRESS_LIMIT) {
+        printf("MAC ID block runs past FF:FF:FF:FF:FF:FF.\n");
+        return -1;
+    } else if ((base >> 40) & 1) {
+        printf("MAC ID %s is a multicast address.\n", arg);
+        return -1;
+    }
+
+    // Slots past the block are cleared so no stale address survives
+    char macId[MAC_TEXT_LENGTH];
+    memset(out, 0, MAC_ID_COUNT * MAC_ID_LENGTH);
+    for (int i = 0; i < macIdCount; i++) {
+        macPut(out + i * MAC_ID_LENGTH, base + i);
+        if (eepromFieldMessages) {
+            macFormat(base + i, macId);
+            printf("MAC ID %d updated successfully: %s\n", i + 1, macId);
+        }
+    }
+    return MAC_ID_COUNT * MAC_ID_LENGTH;
+}
+
+// Function to print the message for a cleared field
+static inline void eepromFieldCleared(int id) {
+    if (eepromFields[id].encoding == FIELD_MAC) {
+        printf("MAC IDs cleared.\n");
+    } else {
+        printf("%s cleared.\n", eepromFields[id].label);
+    }
+}
+
+// Function to format a field read back from the image as one line of
+// text; MAC IDs are separated by spaces, with "-" for an empty slot. Text
+// drops trailing 0x00 and 0xFF padding and escapes bytes that are not
+// printable as \xNN, four output bytes per field byte at most. A blank
+// field is "-".
+static inline void eepromFieldFormat(int id, const char *data, char *out, size_t size) {
+    const EepromFieldInfo *field = &eepromFields[id];
+
+    if (field->encoding == FIELD_MAC) {
+        size_t used = 0;
+        out[0] = '\0';
+        for (int i = 0; i < MAC_ID_COUNT && used < size; i++) {
+            char macId[MAC_TEXT_LENGTH] = "-";
+            uint64_t mac = macGet(data + i * MAC_ID_LENGTH);
+            if (mac != 0 && mac != MAC_ADDRESS_LIMIT - 1) {
+                macFormat(mac, macId);
+            }
+            used += snprintf(out + used, size - used, "%s%s", i ? " " : "", macId);
+        }
+        return;
+    }
+
+    unsigned int end = field->length;
+    while (end > 0 && (data[end - 1] == '\0' || (unsigned char)data[end - 1] == 0xFF)) {
+        end--;
+    }
+    if (end == 0) {
+        snprintf(out, size, "-");
+        return;
+    }
+    size_t used = 0;
+    out[0] = '\0';
+    for (unsigned int i = 0; i < end && used + 5 <= size; i++) {
+        unsigned char c = data[i];
+        used += snprintf(out + used, size - used, isprint(c) && c != '\\' ? "%c" : "\\x%02X", c);
+    }
+}
+
+// Function to print a field read back from the image
+static inline void eepromFieldPrint(int id, const char *data) {
+    const EepromFieldInfo *field = &eepromFields[id];
+
+    if (field->encoding == FIELD_MAC) {
+        for (int i = 0; i < MAC_ID_COUNT; i++) {
+            char macId[MAC_TEXT_LENGTH];
+            uint64_t mac = macGet(data + i * MAC_ID_LENGTH);
+            if (mac == 0 || mac == MAC_ADDRESS_LIMIT - 1) {
+                printf("MAC ID %d: not set\n", i + 1);
+                continue;
+            }
+            macFormat(mac, macId);
+            printf("MAC ID %d: %s\n", i + 1, macId);
+        }
+        return;
+    }
+
+    char value[EEPROM_LAYOUT_LIMIT + 1];
+    memcpy(value, data, field->length);
+    value[field->length] = '\0';
+    printf("%s: %s\n", field->label, value);
+}
+
+#endif // EEPROM_LAYOUT_H
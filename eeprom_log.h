@@ -0,0 +1,226 @@
+#ifndef EEPROM_LOG_H
+#define EEPROM_LOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "eeprom_layout.h"
+
+// Append-only record log for frequently updated values.
+//
+// The log fills the image from the end of the fixed fields to the end of
+// the image (at most EEPROM_LAYOUT_LIMIT) in slots of EEPROM_LOG_SLOT bytes. An update appends
+// one record to the next free slot, so it costs a single page write on
+// parts with pages of at least one slot (the I2C tool refuses to append
+// on smaller pages) and successive updates walk across the whole area
+// instead of wearing out one page. Startup rebuilds the latest value of every key with one
+// sequential scan: the record with the highest sequence number wins.
+//
+// When the area is full the live records are copied to the front in slot
+// order. Every copy lands on its own slot or on one that is already
+// stale. An interrupted compaction leaves live records that were not
+// copied yet behind the new head, so appends skip every slot that still
+// holds the latest record of a key.
+
+// Record slot: key, flags, sequence (LE), value (LE), CRC16 of the rest
+#define EEPROM_LOG_SLOT 16
+#define EEPROM_LOG_VALUE_OFFSET 6
+#define EEPROM_LOG_CRC_OFFSET 14
+
+// Keys 1..254; 0x00 and 0xFF mark an erased slot
+#define EEPROM_LOG_KEY_MIN 1
+#define EEPROM_LOG_KEY_MAX 254
+#define EEPROM_LOG_KEYS 256
+
+typedef struct {
+    unsigned int begin;            // First byte of the area, slot aligned
+    unsigned int slots;
+    unsigned int head;             // Next slot to append to
+    uint32_t sequence;             // Highest sequence number seen
+    int latest[EEPROM_LOG_KEYS];   // Slot of the newest record per key, -1 if none
+    unsigned int live;             // Keys with a value
+    unsigned long appends;         // Records written by this run
+    unsigned long compactions;
+} EepromLog;
+
+// Function to persist one record slot, returns 0 on success
+typedef int (*EepromLogWrite)(void *context, unsigned int offset, const char *record, unsigned int length);
+
+// Function to find the log area of a layout
+static inline unsigned int eepromLogBegin(const EepromLayout *layout) {
+    return (layout->end + EEPROM_LOG_SLOT - 1) / EEPROM_LOG_SLOT * EEPROM_LOG_SLOT;
+}
+
+static inline unsigned int eepromLogEnd(size_t imageSize) {
+    return imageSize < EEPROM_LAYOUT_LIMIT ? (unsigned int)imageSize : EEPROM_LAYOUT_LIMIT;
+}
+
+// Function to compute the check value of a record
+static inline uint16_t eepromLogCrc(const char *record) {
+    return (uint16_t)crc32c(record, EEPROM_LOG_CRC_OFFSET);
+}
+
+// Function to check whether a slot holds an intact record
+static inline int eepromLogValid(const char *record) {
+    unsigned char key = record[0];
+    const unsigned char *crc = (const unsigned char *)record + EEPROM_LOG_CRC_OFFSET;
+
+    return key >= EEPROM_LOG_KEY_MIN && key <= EEPROM_LOG_KEY_MAX &&
+           (crc[0] | (crc[1] << 8)) == eepromLogCrc(record);
+}
+
+static inline uint64_t eepromLogValue(const char *record) {
+    return eepromGetU32(record + EEPROM_LOG_VALUE_OFFSET) |
+           ((uint64_t)eepromGetU32(record + EEPROM_LOG_VALUE_OFFSET + 4) << 32);
+}
+
+static inline void eepromLogEncode(char *record, int key, uint32_t sequence, uint64_t value) {
+    uint16_t crc;
+
+    record[0] = key;
+    record[1] = 0;
+    eepromPutU32(record + 2, sequence);
+    eepromPutU32(record + EEPROM_LOG_VALUE_OFFSET, (uint32_t)value);
+    eepromPutU32(record + EEPROM_LOG_VALUE_OFFSET + 4, (uint32_t)(value >> 32));
+    crc = eepromLogCrc(record);
+    record[EEPROM_LOG_CRC_OFFSET] = crc & 0xFF;
+    record[EEPROM_LOG_CRC_OFFSET + 1] = crc >> 8;
+}
+
+// Function to rebuild the latest values from one pass over the area
+static inline void eepromLogScan(EepromLog *log, const EepromLayout *layout, const char *image, size_t imageSize) {
+    uint32_t newest[EEPROM_LOG_KEYS];
+    int headSlot = -1;
+
+    memset(log, 0, sizeof(*log));
+    log->begin = eepromLogBegin(layout);
+    unsigned int end = eepromLogEnd(imageSize);
+
+    log->slots = end > log->begin ? (end - log->begin) / EEPROM_LOG_SLOT : 0;
+    for (int key = 0; key < EEPROM_LOG_KEYS; key++) {
+        log->latest[key] = -1;
+    }
+
+    for (unsigned int slot = 0; slot < log->slots; slot++) {
+        const char *record = image + log->begin + slot * EEPROM_LOG_SLOT;
+        if (!eepromLogValid(record)) {
+            continue;
+        }
+        unsigned char key = record[0];
+        uint32_t sequence = eepromGetU32(record + 2);
+        if (log->latest[key] < 0 || sequence > newest[key]) {
+            log->live += log->latest[key] < 0;
+            log->latest[key] = slot;
+            newest[key] = sequence;
+        }
+        if (headSlot < 0 || sequence > log->sequence) {
+            log->sequence = sequence;
+            headSlot = slot;
+        }
+    }
+    log->head = headSlot + 1;
+}
+
+// Function to read the latest value of a key, returns -1 if it has none
+static inline int eepromLogGet(const EepromLog *log, const char *image, int key, uint64_t *value) {
+    if (key < EEPROM_LOG_KEY_MIN || key > EEPROM_LOG_KEY_MAX || log->latest[key] < 0) {
+        return -1;
+    }
+    *value = eepromLogValue(image + log->begin + log->latest[key] * EEPROM_LOG_SLOT);
+    return 0;
+}
+
+// Function to check whether a slot holds the latest record of its key
+static inline int eepromLogLive(const EepromLog *log, const char *image, unsigned int slot) {
+    const char *record = image + log->begin + slot * EEPROM_LOG_SLOT;
+
+    return eepromLogValid(record) && log->latest[(unsigned char)record[0]] == (int)slot;
+}
+
+// Function to copy the live records to the front of the area in slot order
+static inline int eepromLogCompact(EepromLog *log, const char *image, EepromLogWrite write, void *context) {
+    unsigned int target = 0;
+    char record[EEPROM_LOG_SLOT];
+
+    for (unsigned int slot = 0; slot < log->slots; slot++) {
+        const char *current = image + log->begin + slot * EEPROM_LOG_SLOT;
+        if (!eepromLogLive(log, image, slot)) {
+            continue;
+        }
+        int key = (unsigned char)current[0];
+        eepromLogEncode(record, key, ++log->sequence, eepromLogValue(current));
+        if (write(context, log->begin + target * EEPROM_LOG_SLOT, record, EEPROM_LOG_SLOT) != 0) {
+            return -1;
+        }
+        log->latest[key] = target++;
+    }
+    log->head = target;
+    log->compactions++;
+    return 0;
+}
+
+// Function to append a new value for a key. An unchanged value writes nothing.
+static inline int eepromLogSet(EepromLog *log, const char *image, int key, uint64_t value,
+                               EepromLogWrite write, void *context) {
+    uint64_t current;
+    char record[EEPROM_LOG_SLOT];
+
+    if (key < EEPROM_LOG_KEY_MIN || key > EEPROM_LOG_KEY_MAX) {
+        printf("Invalid log key. Must be between %d and %d.\n", EEPROM_LOG_KEY_MIN, EEPROM_LOG_KEY_MAX);
+        return -1;
+    }
+    if (eepromLogGet(log, image, key, &current) == 0 && current == value) {
+        return 0;
+    }
+    // A new key needs room for itself once every live record is compacted
+    if (log->live + (log->latest[key] < 0) > log->slots) {
+        printf("Log area is full: %u keys in %u slots.\n", log->live, log->slots);
+        return -1;
+    }
+    while (log->head < log->slots && eepromLogLive(log, image, log->head)) {
+        log->head++;
+    }
+    if (log->head >= log->slots && eepromLogCompact(log, image, write, context) != 0) {
+        return -1;
+    }
+    if (log->head >= log->slots) {
+        printf("Log area is full: %u keys in %u slots.\n", log->live, log->slots);
+        return -1;
+    }
+
+    eepromLogEncode(record, key, ++log->sequence, value);
+    if (write(context, log->begin + log->head * EEPROM_LOG_SLOT, record, EEPROM_LOG_SLOT) != 0) {
+        return -1;
+    }
+    log->live += log->latest[key] < 0;
+    log->latest[key] = log->head++;
+    log->appends++;
+    return 0;
+}
+
+// Function to parse a <key>=<value> log argument, returns -1 if malformed
+static inline int eepromLogParse(const char *arg, int *key, uint64_t *value) {
+    char *end;
+
+    *key = (int)strtol(arg, &end, 0);
+    if (*end != '=' || end[1] == '\0') {
+        return -1;
+    }
+    *value = strtoull(end + 1, &end, 0);
+    return *end == '\0' ? 0 : -1;
+}
+
+// Function to print every key with a value
+static inline void eepromLogPrint(const EepromLog *log, const char *image) {
+    uint64_t value;
+
+    for (int key = EEPROM_LOG_KEY_MIN; key <= EEPROM_LOG_KEY_MAX; key++) {
+        if (eepromLogGet(log, image, key, &value) == 0) {
+            printf("Log %d: %llu\n", key, (unsigned long long)value);
+        }
+    }
+    printf("Log area: %u keys, %u of %u slots used\n", log->live, log->head, log->slots);
+}
+
+#endif // EEPROM_LOG_H
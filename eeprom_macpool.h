@@ -0,0 +1,280 @@
+#ifndef EEPROM_MACPOOL_H
+#define EEPROM_MACPOOL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// MAC address pool shared by every provisioning process.
+//
+// The pool is a small state file holding the address range and a cursor.
+// It is mapped MAP_SHARED by every process, and blocks are taken by
+// advancing the cursor with compare-and-swap, so concurrent processes and
+// threads never get overlapping blocks. The cursor page is synced before
+// the addresses are used, so a crash cannot hand out a block twice.
+
+#define MAC_POOL_MAGIC 0x4C4F4F50 // "POOL"
+#define MAC_POOL_VERSION 1
+
+// First address of a count given without a pool, the block the tools
+// have always generated (A0:FC:72:00:53:01 onwards)
+#define MAC_DEFAULT_BASE 0xA0FC72005301ull
+
+// Largest address value, 48 bits
+#define MAC_ADDRESS_LIMIT (1ull << 48)
+
+// First reservation of a thread, each later one doubles up to the reserve
+#define MAC_POOL_FIRST_RESERVE 64
+
+// Length of "XX:XX:XX:XX:XX:XX" plus the terminator
+#define MAC_TEXT_LENGTH 18
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t first;          // First address of the pool
+    uint64_t end;            // One past the last address
+    _Atomic uint64_t next;   // Next free address
+    _Atomic uint64_t blocks; // Blocks handed out so far
+} MacPoolState;
+
+typedef struct {
+    int fd;
+    MacPoolState *state;
+    unsigned int reserve; // Addresses a thread takes at once, 0 for exact blocks
+} MacPool;
+
+// Addresses reserved by this thread and not handed out yet
+static __thread uint64_t macPoolCacheNext;
+static __thread uint64_t macPoolCacheEnd;
+static __thread uint64_t macPoolCacheSize; // Size of the last reservation
+
+// Function to format an address in colon notation
+static inline void macFormat(uint64_t mac, char *text) {
+    snprintf(text, MAC_TEXT_LENGTH, "%02X:%02X:%02X:%02X:%02X:%02X", (unsigned int)(mac >> 40) & 0xFF,
+             (unsigned int)(mac >> 32) & 0xFF, (unsigned int)(mac >> 24) & 0xFF, (unsigned int)(mac >> 16) & 0xFF,
+             (unsigned int)(mac >> 8) & 0xFF, (unsigned int)mac & 0xFF);
+}
+
+// Function to parse colon-separated hex octets.
+// Returns the number of octets read (3 for an OUI, 6 for an address) or
+// -1; *end is set past the parsed text.
+static inline int macParse(const char *text, uint64_t *mac, const char **end) {
+    int octets = 0;
+
+    *mac = 0;
+    for (;;) {
+        char *after;
+        if (!((text[0] >= '0' && text[0] <= '9') || (text[0] >= 'a' && text[0] <= 'f') || (text[0] >= 'A' && text[0] <= 'F'))) {
+            return -1;
+        }
+        unsigned long octet = strtoul(text, &after, 16);
+        if (after - text != 2 || octet > 0xFF) {
+            return -1;
+        }
+        *mac = (*mac << 8) | octet;
+        octets++;
+        text = after;
+        if (*text != ':' || octets == 6) {
+            break;
+        }
+        text++;
+    }
+    *end = text;
+    return octets == 3 || octets == 6 ? octets : -1;
+}
+
+// Function to read a binary address stored big-endian in a 6-byte slot
+static inline uint64_t macGet(const char *slot) {
+    const unsigned char *bytes = (const unsigned char *)slot;
+    uint64_t mac = 0;
+
+    for (int i = 0; i < 6; i++) {
+        mac = (mac << 8) | bytes[i];
+    }
+    return mac;
+}
+
+// Function to store a binary address big-endian in a 6-byte slot
+static inline void macPut(char *slot, uint64_t mac) {
+    for (int i = 5; i >= 0; i--) {
+        slot[i] = mac & 0xFF;
+        mac >>= 8;
+    }
+}
+
+// Function to create a pool state file for a range given as
+// <OUI> (the whole 24-bit space) or <first>[-<last>]
+static inline int macPoolCreate(const char *path, const char *range) {
+    uint64_t first, last;
+    const char *end;
+    int octets = macParse(range, &first, &end);
+
+    if (octets == 3 && *end == '\0') {
+        first <<= 24;
+        last = first | 0xFFFFFF;
+    } else if (octets == 6 && *end == '\0') {
+        last = first | 0xFFFFFF;
+    } else if (octets == 6 && *end == '-' && macParse(end + 1, &last, &end) == 6 && *end == '\0') {
+    } else {
+        fprintf(stderr, "Invalid MAC pool range %s\n", range);
+        return -1;
+    }
+    if (last < first) {
+        fprintf(stderr, "MAC pool range %s is empty\n", range);
+        return -1;
+    }
+    // Multicast addresses cannot be assigned to an interface, and every
+    // range that crosses the multicast bit holds some
+    if (((first >> 40) & 1) || (first >> 40) != (last >> 40)) {
+        fprintf(stderr, "MAC pool range %s includes multicast addresses\n", range);
+        return -1;
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        perror("Failed to create MAC pool");
+        return -1;
+    }
+    MacPoolState state = {MAC_POOL_MAGIC, MAC_POOL_VERSION, first, last + 1, first, 0};
+    int ok = write(fd, &state, sizeof(state)) == sizeof(state) && fsync(fd) == 0;
+    if (close(fd) != 0 || !ok) {
+        perror("Failed to create MAC pool");
+        unlink(path);
+        return -1;
+    }
+    return 0;
+}
+
+// Function to map an existing pool state file
+static inline int macPoolOpen(MacPool *pool, const char *path) {
+    struct stat st;
+
+    memset(pool, 0, sizeof(*pool));
+    pool->fd = open(path, O_RDWR);
+    if (pool->fd < 0) {
+        perror("Failed to open MAC pool");
+        return -1;
+    }
+    if (fstat(pool->fd, &st) != 0 || st.st_size < (off_t)sizeof(MacPoolState)) {
+        fprintf(stderr, "MAC pool %s is truncated\n", path);
+        close(pool->fd);
+        return -1;
+    }
+    pool->state = mmap(NULL, sizeof(MacPoolState), PROT_READ | PROT_WRITE, MAP_SHARED, pool->fd, 0);
+    if (pool->state == MAP_FAILED) {
+        perror("Failed to map MAC pool");
+        pool->state = NULL;
+        close(pool->fd);
+        return -1;
+    }
+    if (pool->state->magic != MAC_POOL_MAGIC || pool->state->version != MAC_POOL_VERSION) {
+        fprintf(stderr, "%s is not a MAC pool\n", path);
+        munmap(pool->state, sizeof(MacPoolState));
+        pool->state = NULL;
+        close(pool->fd);
+        return -1;
+    }
+    return 0;
+}
+
+// Function to hand the unused rest of this thread's reservation back.
+// That only works while the cursor still sits at its end; once another
+// thread has reserved past it, the rest stays unused.
+static inline void macPoolRelease(MacPool *pool) {
+    uint64_t end = macPoolCacheEnd;
+
+    if (pool->state && macPoolCacheNext < end &&
+        atomic_compare_exchange_strong(&pool->state->next, &end, macPoolCacheNext) &&
+        msync(pool->state, sizeof(MacPoolState), MS_SYNC) != 0) {
+        perror("Failed to save MAC pool");
+    }
+    macPoolCacheNext = macPoolCacheEnd = 0;
+}
+
+// Function to take a contiguous block of count addresses.
+// Returns 0 and the first address, or -1 when the pool is exhausted.
+static inline int macPoolAllocate(MacPool *pool, unsigned int count, uint64_t *first) {
+    MacPoolState *state = pool->state;
+
+    if (macPoolCacheEnd - macPoolCacheNext >= count) {
+        *first = macPoolCacheNext;
+        macPoolCacheNext += count;
+        atomic_fetch_add(&state->blocks, 1);
+        return 0;
+    }
+
+    // A block never straddles two reservations, return the rest of the old one first
+    macPoolRelease(pool);
+    // Reservations grow with use, a short run strands few addresses
+    uint64_t take = macPoolCacheSize ? macPoolCacheSize * 2 : MAC_POOL_FIRST_RESERVE;
+    if (take > pool->reserve) {
+        take = pool->reserve;
+    }
+    if (take < count) {
+        take = count;
+    }
+    uint64_t next = atomic_load(&state->next);
+    do {
+        if (next + count > state->end) {
+            return -1;
+        }
+        if (next + take > state->end) {
+            take = state->end - next;
+        }
+    } while (!atomic_compare_exchange_weak(&state->next, &next, next + take));
+
+    if (msync(state, sizeof(MacPoolState), MS_SYNC) != 0) {
+        perror("Failed to save MAC pool");
+        return -1;
+    }
+    *first = next;
+    macPoolCacheNext = next + count;
+    macPoolCacheEnd = next + take;
+    macPoolCacheSize = take;
+    atomic_fetch_add(&state->blocks, 1);
+    return 0;
+}
+
+// Function to print the range and usage of a pool
+static inline void macPoolPrint(const MacPool *pool) {
+    char first[MAC_TEXT_LENGTH], last[MAC_TEXT_LENGTH], next[MAC_TEXT_LENGTH];
+    uint64_t cursor = atomic_load(&pool->state->next);
+
+    macFormat(pool->state->first, first);
+    macFormat(pool->state->end - 1, last);
+    macFormat(cursor, next);
+    printf("MAC pool %s - %s: next %s, %llu addresses left, %llu blocks allocated\n", first, last,
+           cursor < pool->state->end ? next : "none", (unsigned long long)(pool->state->end - cursor),
+           (unsigned long long)atomic_load(&pool->state->blocks));
+}
+
+// Function to open the pool at path, creating it first when a range is given
+static inline int macPoolSetup(MacPool *pool, const char *path, const char *range) {
+    if (range && macPoolCreate(path, range) != 0) {
+        return -1;
+    }
+    if (macPoolOpen(pool, path) != 0) {
+        return -1;
+    }
+    if (range) {
+        macPoolPrint(pool);
+    }
+    return 0;
+}
+
+static inline void macPoolClose(MacPool *pool) {
+    if (pool->state) {
+        munmap(pool->state, sizeof(MacPoolState));
+        pool->state = NULL;
+        close(pool->fd);
+    }
+}
+
+#endif // EEPROM_MACPOOL_H
@@ -0,0 +1,211 @@
+#ifndef EEPROM_METRICS_H
+#define EEPROM_METRICS_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+
+// Per-operation counters and latency histograms.
+//
+// Recording is off until --metrics enables it, so an uninstrumented run
+// pays one branch per operation. When enabled, each operation costs two
+// clock reads and a few relaxed atomic adds, and the counters are shared by
+// every thread (fleet bus workers, the daemon writer) without merging.
+
+// Instrumented operations: id, label, description
+#define EEPROM_METRIC_OPS(X) \
+    X(WRITE, "write", "Page-bounded writes to the device") \
+    X(POLL, "poll", "Write cycles completed by ACK polling, retries are NACKed polls") \
+    X(READ, "read", "Reads from the device") \
+    X(LOAD, "load", "Image or shadow file loads") \
+    X(SAVE, "save", "Image or shadow file saves") \
+    X(DUMP, "dump", "Hex dumps written to the console")
+
+enum {
+#define METRIC_ENUM(id, label, help) METRIC_##id,
+    EEPROM_METRIC_OPS(METRIC_ENUM)
+#undef METRIC_ENUM
+    METRIC_COUNT
+};
+
+// Histogram buckets: <= 1 us, 2 us, 4 us, ... 2^24 us (about 16.8 s), then +Inf
+#define METRIC_BUCKETS 26
+
+typedef struct {
+    unsigned long count;
+    unsigned long errors;
+    unsigned long bytes;
+    unsigned long transactions;
+    unsigned long retries;
+    unsigned long nanoseconds;
+    unsigned long buckets[METRIC_BUCKETS];
+} EepromMetric;
+
+static const struct {
+    const char *label;
+    const char *help;
+} eepromMetricOps[METRIC_COUNT] = {
+#define METRIC_INFO(id, label, help) {label, help},
+    EEPROM_METRIC_OPS(METRIC_INFO)
+#undef METRIC_INFO
+};
+
+static int eepromMetricsEnabled;
+static EepromMetric eepromMetrics[METRIC_COUNT];
+
+// Function to read the monotonic clock in nanoseconds
+static inline uint64_t eepromMetricsNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Function to start timing an operation, 0 while metrics are off
+static inline uint64_t eepromMetricStart(void) {
+    return eepromMetricsEnabled ? eepromMetricsNow() : 0;
+}
+
+// Function to find the histogram bucket of a latency
+static inline int eepromMetricBucket(uint64_t nanoseconds) {
+    uint64_t micros = (nanoseconds + 999) / 1000;
+    if (micros <= 1) {
+        return 0;
+    }
+    int bucket = 64 - __builtin_clzll(micros - 1);
+    return bucket < METRIC_BUCKETS - 1 ? bucket : METRIC_BUCKETS - 1;
+}
+
+// Function to record one finished operation
+static inline void eepromMetricRecord(int op, uint64_t start, unsigned long bytes, unsigned long transactions,
+                                      unsigned long retries, int failed) {
+    if (!eepromMetricsEnabled) {
+        return;
+    }
+    uint64_t elapsed = eepromMetricsNow() - start;
+    EepromMetric *metric = &eepromMetrics[op];
+
+    __atomic_fetch_add(&metric->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&metric->errors, failed != 0, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&metric->bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&metric->transactions, transactions, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&metric->retries, retries, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&metric->nanoseconds, elapsed, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&metric->buckets[eepromMetricBucket(elapsed)], 1, __ATOMIC_RELAXED);
+}
+
+// Function to take a consistent-enough copy of one operation's counters
+static inline void eepromMetricSnapshot(int op, EepromMetric *copy) {
+    const EepromMetric *metric = &eepromMetrics[op];
+
+    copy->count = __atomic_load_n(&metric->count, __ATOMIC_RELAXED);
+    copy->errors = __atomic_load_n(&metric->errors, __ATOMIC_RELAXED);
+    copy->bytes = __atomic_load_n(&metric->bytes, __ATOMIC_RELAXED);
+    copy->transactions = __atomic_load_n(&metric->transactions, __ATOMIC_RELAXED);
+    copy->retries = __atomic_load_n(&metric->retries, __ATOMIC_RELAXED);
+    copy->nanoseconds = __atomic_load_n(&metric->nanoseconds, __ATOMIC_RELAXED);
+    for (int i = 0; i < METRIC_BUCKETS; i++) {
+        copy->buckets[i] = __atomic_load_n(&metric->buckets[i], __ATOMIC_RELAXED);
+    }
+}
+
+// Function to print the counters in the Prometheus text format
+static inline void eepromMetricsPrometheus(FILE *stream, const char *tool) {
+    static const struct {
+        const char *name;
+        const char *help;
+        size_t field;
+    } counters[] = {
+        {"eeprom_op_errors_total", "Operations that failed", offsetof(EepromMetric, errors)},
+        {"eeprom_op_bytes_total", "Bytes moved by the operation", offsetof(EepromMetric, bytes)},
+        {"eeprom_op_transactions_total", "Bus transactions or pages", offsetof(EepromMetric, transactions)},
+        {"eeprom_op_retries_total", "Retries, such as NACKed ACK polls", offsetof(EepromMetric, retries)},
+    };
+    EepromMetric snapshot[METRIC_COUNT];
+
+    for (int op = 0; op < METRIC_COUNT; op++) {
+        eepromMetricSnapshot(op, &snapshot[op]);
+    }
+
+    fprintf(stream, "# HELP eeprom_op_seconds Latency of EEPROM tool operations\n");
+    fprintf(stream, "# TYPE eeprom_op_seconds histogram\n");
+    for (int op = 0; op < METRIC_COUNT; op++) {
+        unsigned long cumulative = 0;
+        const char *label = eepromMetricOps[op].label;
+        for (int i = 0; i < METRIC_BUCKETS - 1; i++) {
+            cumulative += snapshot[op].buckets[i];
+            fprintf(stream, "eeprom_op_seconds_bucket{tool=\"%s\",op=\"%s\",le=\"%g\"} %lu\n", tool, label,
+                    (double)(1UL << i) / 1e6, cumulative);
+        }
+        fprintf(stream, "eeprom_op_seconds_bucket{tool=\"%s\",op=\"%s\",le=\"+Inf\"} %lu\n", tool, label,
+                snapshot[op].count);
+        fprintf(stream, "eeprom_op_seconds_sum{tool=\"%s\",op=\"%s\"} %.9f\n", tool, label,
+                snapshot[op].nanoseconds / 1e9);
+        fprintf(stream, "eeprom_op_seconds_count{tool=\"%s\",op=\"%s\"} %lu\n", tool, label, snapshot[op].count);
+    }
+    for (size_t c = 0; c < sizeof(counters) / sizeof(counters[0]); c++) {
+        fprintf(stream, "# HELP %s %s\n# TYPE %s counter\n", counters[c].name, counters[c].help, counters[c].name);
+        for (int op = 0; op < METRIC_COUNT; op++) {
+            fprintf(stream, "%s{tool=\"%s\",op=\"%s\"} %lu\n", counters[c].name, tool, eepromMetricOps[op].label,
+                    *(const unsigned long *)((const char *)&snapshot[op] + counters[c].field));
+        }
+    }
+}
+
+// Function to print the counters as one JSON object
+static inline void eepromMetricsJson(FILE *stream, const char *tool) {
+    fprintf(stream, "{\"tool\": \"%s\", \"histogramBucketsUs\": [", tool);
+    for (int i = 0; i < METRIC_BUCKETS - 1; i++) {
+        fprintf(stream, "%s%lu", i ? ", " : "", 1UL << i);
+    }
+    fprintf(stream, ", null], \"operations\": {");
+    for (int op = 0; op < METRIC_COUNT; op++) {
+        EepromMetric metric;
+        eepromMetricSnapshot(op, &metric);
+        fprintf(stream, "%s\n  \"%s\": {\"count\": %lu, \"errors\": %lu, \"bytes\": %lu, \"transactions\": %lu, "
+                "\"retries\": %lu, \"seconds\": %.9f, \"histogram\": [",
+                op ? "," : "", eepromMetricOps[op].label, metric.count, metric.errors, metric.bytes,
+                metric.transactions, metric.retries, metric.nanoseconds / 1e9);
+        for (int i = 0; i < METRIC_BUCKETS; i++) {
+            fprintf(stream, "%s%lu", i ? ", " : "", metric.buckets[i]);
+        }
+        fprintf(stream, "]}");
+    }
+    fprintf(stream, "\n}}\n");
+}
+
+// Function to check whether a metrics path asks for JSON
+static inline int eepromMetricsIsJson(const char *path) {
+    size_t length = strlen(path);
+    return length >= 5 && strcmp(path + length - 5, ".json") == 0;
+}
+
+// Function to write the metrics file: JSON for *.json, Prometheus text
+// otherwise. The file is replaced by rename, so a collector never reads
+// a partial export.
+static inline int eepromMetricsWrite(const char *path, const char *tool) {
+    char temporary[PATH_MAX];
+
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    FILE *stream = fopen(temporary, "w");
+    if (!stream) {
+        perror("Failed to write metrics");
+        return -1;
+    }
+    if (eepromMetricsIsJson(path)) {
+        eepromMetricsJson(stream, tool);
+    } else {
+        eepromMetricsPrometheus(stream, tool);
+    }
+    if (fclose(stream) != 0 || rename(temporary, path) != 0) {
+        perror("Failed to write metrics");
+        unlink(temporary);
+        return -1;
+    }
+    return 0;
+}
+
+#endif // EEPROM_METRICS_H
@@ -0,0 +1,377 @@
+#ifndef EEPROM_SIM_H
+#define EEPROM_SIM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "eeprom_bus.h"
+#include "eeprom_store.h"
+
+// Simulated I2C bus with 24Cxx EEPROMs behind it.
+//
+// Selected with a bus path of the form sim[<name>][:<option>,...]:
+//   clock=100k|400k|1M  bus clock (default 400k)
+//   twr=<ms>            internal write cycle time (default 5)
+//   devices=<n>         devices answering from 0x50 upwards (default 1)
+//                       parts with block select bits take several addresses each
+//   errors=<p>          probability that a transfer is NACKed (default 0)
+//   seed=<n>            seed of the error injection
+//   image=<path>        back the device at 0x50 with an image file
+//   smbus               adapter without plain I2C, SMBus transfers only
+//
+// Each device models a part's size, page size and addressing: the address
+// counter wraps at the end of the part and a page write wraps inside its
+// page. Address bits beyond the address bytes (24C04-24C16, 24M01/24M02)
+// are taken from the low bits of the slave address, so such a device
+// answers on several consecutive addresses.
+// After a write the device NACKs its address until the write cycle is
+// over. Every transfer takes the time its bits need at the bus clock, so
+// rates and latencies measured against the simulator are real ones.
+
+#define EEPROM_SIM_BASE_ADDRESS 0x50
+#define EEPROM_SIM_MAX_DEVICES 8
+
+typedef struct {
+    char *data;
+    unsigned int pointer;  // Internal address counter
+    double busyUntil;      // End of the current write cycle
+} EepromSimDevice;
+
+typedef struct {
+    unsigned int size;
+    unsigned int pageSize;
+    unsigned int addressBytes; // Memory address bytes after the slave address
+    unsigned int blockBits;    // Address bits carried in the slave address
+    double clockHz;
+    double writeCycle;     // Seconds
+    double errorRate;
+    unsigned int seed;
+    int smbusOnly;
+    int deviceCount;
+    EepromSimDevice devices[EEPROM_SIM_MAX_DEVICES];
+    EepromStore image;     // Backing file of the first device
+    int imageOpen;
+    unsigned short slave;  // Address selected with I2C_SLAVE
+    unsigned long transfers;
+    unsigned long nacks;
+} EepromSim;
+
+// Monotonic time in seconds
+static inline double eepromSimNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Function to hold the bus for the time a number of bits takes
+static inline void eepromSimClock(EepromSim *sim, double start, unsigned long bits) {
+    double end = start + bits / sim->clockHz;
+    struct timespec until = {(time_t)end, (long)((end - (time_t)end) * 1e9)};
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR) {
+    }
+}
+
+// Function to address a device: returns it and the block selected by the
+// slave address, or NULL after a NACK. Absent devices, devices in their
+// write cycle and injected errors NACK.
+static inline EepromSimDevice *eepromSimAddress(EepromSim *sim, unsigned short address, double now,
+                                                unsigned int *block) {
+    int index = (address - EEPROM_SIM_BASE_ADDRESS) >> sim->blockBits;
+
+    *block = (address - EEPROM_SIM_BASE_ADDRESS) & ((1u << sim->blockBits) - 1);
+    sim->transfers++;
+    if (address < EEPROM_SIM_BASE_ADDRESS || index >= sim->deviceCount || now < sim->devices[index].busyUntil ||
+        (sim->errorRate > 0 && rand_r(&sim->seed) < sim->errorRate * ((double)RAND_MAX + 1))) {
+        sim->nacks++;
+        errno = ENXIO;
+        return NULL;
+    }
+    return &sim->devices[index];
+}
+
+// Function to apply a write message: the address bytes, then data that
+// wraps inside the page. Data starts the write cycle at the stop condition.
+static inline void eepromSimWriteMessage(EepromSim *sim, EepromSimDevice *device, unsigned int block,
+                                         const unsigned char *data, size_t length, double stop) {
+    unsigned int address = block;
+    size_t header = sim->addressBytes;
+
+    if (length < header) {
+        return;
+    }
+    for (size_t i = 0; i < header; i++) {
+        address = (address << 8) | data[i];
+    }
+    device->pointer = address & (sim->size - 1);
+
+    unsigned int page = device->pointer & ~(sim->pageSize - 1);
+    for (size_t i = header; i < length; i++) {
+        device->data[page | ((device->pointer + i - header) & (sim->pageSize - 1))] = data[i];
+    }
+    if (length > header) {
+        device->pointer = page | ((device->pointer + length - header) & (sim->pageSize - 1));
+        device->busyUntil = stop + sim->writeCycle;
+    }
+}
+
+// Function to read sequentially from the address counter, wrapping at the end of the part
+static inline void eepromSimReadMessage(EepromSim *sim, EepromSimDevice *device, unsigned char *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        data[i] = device->data[device->pointer];
+        device->pointer = (device->pointer + 1) & (sim->size - 1);
+    }
+}
+
+static inline int eepromSimSetSlave(I2cBus *bus, unsigned short address) {
+    ((EepromSim *)bus->device)->slave = address;
+    return 0;
+}
+
+static inline int eepromSimFunctions(I2cBus *bus, unsigned long *funcs) {
+    EepromSim *sim = bus->device;
+
+    *funcs = I2C_FUNC_SMBUS_WRITE_I2C_BLOCK | I2C_FUNC_SMBUS_WRITE_BYTE_DATA | I2C_FUNC_SMBUS_WRITE_BYTE |
+             I2C_FUNC_SMBUS_READ_BYTE | I2C_FUNC_SMBUS_READ_I2C_BLOCK;
+    if (!sim->smbusOnly) {
+        *funcs |= I2C_FUNC_I2C;
+    }
+    return 0;
+}
+
+// Start, address byte and acknowledge, then 9 bits per byte, then stop
+#define EEPROM_SIM_BITS(bytes) (1 + 9 + 9 * (unsigned long)(bytes) + 1)
+
+static inline ssize_t eepromSimWrite(I2cBus *bus, const void *data, size_t length) {
+    EepromSim *sim = bus->device;
+    double start = eepromSimNow();
+    unsigned int block;
+    EepromSimDevice *device = eepromSimAddress(sim, sim->slave, start, &block);
+
+    if (!device) {
+        eepromSimClock(sim, start, EEPROM_SIM_BITS(0));
+        return -1;
+    }
+    eepromSimClock(sim, start, EEPROM_SIM_BITS(length));
+    eepromSimWriteMessage(sim, device, block, data, length, eepromSimNow());
+    return length;
+}
+
+static inline int eepromSimTransfer(I2cBus *bus, struct i2c_msg *messages, int count) {
+    EepromSim *sim = bus->device;
+    double start = eepromSimNow();
+    unsigned long bits = 0;
+
+    if (sim->smbusOnly) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+    // Messages are joined by repeated starts, the write cycle begins at the final stop
+    EepromSimDevice *written = NULL;
+    for (int i = 0; i < count; i++) {
+        unsigned int block;
+        EepromSimDevice *device = eepromSimAddress(sim, messages[i].addr, start + bits / sim->clockHz, &block);
+        if (!device) {
+            eepromSimClock(sim, start, bits + EEPROM_SIM_BITS(0));
+            return -1;
+        }
+        bits += EEPROM_SIM_BITS(messages[i].len) - 1;
+        if (messages[i].flags & I2C_M_RD) {
+            eepromSimReadMessage(sim, device, messages[i].buf, messages[i].len);
+        } else {
+            eepromSimWriteMessage(sim, device, block, messages[i].buf, messages[i].len, 0);
+            written = messages[i].len > sim->addressBytes ? device : written;
+        }
+    }
+    eepromSimClock(sim, start, bits + 1);
+    if (written) {
+        written->busyUntil = eepromSimNow() + sim->writeCycle;
+    }
+    return count;
+}
+
+static inline int eepromSimSmbus(I2cBus *bus, char readWrite, unsigned char command, int size, union i2c_smbus_data *data) {
+    EepromSim *sim = bus->device;
+    double start = eepromSimNow();
+    unsigned int block;
+    EepromSimDevice *device = eepromSimAddress(sim, sim->slave, start, &block);
+    unsigned char message[2 + I2C_SMBUS_BLOCK_MAX];
+
+    if (!device) {
+        eepromSimClock(sim, start, EEPROM_SIM_BITS(0));
+        return -1;
+    }
+
+    if (readWrite == I2C_SMBUS_READ && size == I2C_SMBUS_BYTE) {
+        eepromSimClock(sim, start, EEPROM_SIM_BITS(1));
+        eepromSimReadMessage(sim, device, message, 1);
+        data->byte = message[0];
+        return 0;
+    }
+    if (readWrite == I2C_SMBUS_WRITE && size == I2C_SMBUS_BYTE) {
+        message[0] = command;
+        eepromSimClock(sim, start, EEPROM_SIM_BITS(1));
+        eepromSimWriteMessage(sim, device, block, message, 1, eepromSimNow());
+        return 0;
+    }
+    if (readWrite == I2C_SMBUS_WRITE && size == I2C_SMBUS_BYTE_DATA) {
+        message[0] = command;
+        message[1] = data->byte;
+        eepromSimClock(sim, start, EEPROM_SIM_BITS(2));
+        eepromSimWriteMessage(sim, device, block, message, 2, eepromSimNow());
+        return 0;
+    }
+    if (readWrite == I2C_SMBUS_WRITE && size == I2C_SMBUS_I2C_BLOCK_DATA && data->block[0] <= I2C_SMBUS_BLOCK_MAX) {
+        message[0] = command;
+        memcpy(message + 1, &data->block[1], data->block[0]);
+        eepromSimClock(sim, start, EEPROM_SIM_BITS(data->block[0] + 1));
+        eepromSimWriteMessage(sim, device, block, message, data->block[0] + 1, eepromSimNow());
+        return 0;
+    }
+    if (readWrite == I2C_SMBUS_READ && size == I2C_SMBUS_I2C_BLOCK_DATA && data->block[0] <= I2C_SMBUS_BLOCK_MAX) {
+        // Command byte as the address, then a repeated start and the read
+        message[0] = command;
+        eepromSimClock(sim, start, EEPROM_SIM_BITS(1) + EEPROM_SIM_BITS(data->block[0]) - 1);
+        eepromSimWriteMessage(sim, device, block, message, 1, 0);
+        eepromSimReadMessage(sim, device, &data->block[1], data->block[0]);
+        return 0;
+    }
+    errno = EOPNOTSUPP;
+    return -1;
+}
+
+static inline void eepromSimClose(I2cBus *bus) {
+    EepromSim *sim = bus->device;
+
+    for (int i = 0; i < sim->deviceCount; i++) {
+        if (!(i == 0 && sim->imageOpen)) {
+            free(sim->devices[i].data);
+        }
+    }
+    if (sim->imageOpen) {
+        eepromStoreTouch(&sim->image, 0, sim->size);
+        eepromStoreCommit(&sim->image);
+        eepromStoreClose(&sim->image);
+    }
+    free(sim);
+    bus->device = NULL;
+}
+
+static const I2cBackend eepromSimBackend = {
+    "sim", eepromSimSetSlave, eepromSimFunctions, eepromSimWrite, eepromSimTransfer, eepromSimSmbus, eepromSimClose,
+};
+
+// Function to tell whether a bus path names the simulator
+static inline int eepromSimPath(const char *path) {
+    return strncmp(path, "sim", 3) == 0;
+}
+
+// Function to parse one simulator option, returns -1 if it is invalid
+static inline int eepromSimOption(EepromSim *sim, char *option, const char **imagePath) {
+    char *value = strchr(option, '=');
+    char *end;
+
+    if (value) {
+        *value++ = '\0';
+    }
+    if (strcmp(option, "smbus") == 0 && !value) {
+        sim->smbusOnly = 1;
+        return 0;
+    }
+    if (!value) {
+        return -1;
+    }
+    if (strcmp(option, "image") == 0) {
+        *imagePath = value;
+        return 0;
+    }
+
+    double number = strtod(value, &end);
+    if (strcmp(option, "clock") == 0) {
+        number *= (*end == 'k' || *end == 'K') ? 1e3 : (*end == 'M') ? 1e6 : 1;
+        end += (*end == 'k' || *end == 'K' || *end == 'M');
+        sim->clockHz = number;
+    } else if (strcmp(option, "twr") == 0) {
+        sim->writeCycle = number / 1000.0;
+    } else if (strcmp(option, "devices") == 0) {
+        sim->deviceCount = (int)number;
+    } else if (strcmp(option, "errors") == 0) {
+        sim->errorRate = number;
+    } else if (strcmp(option, "seed") == 0) {
+        sim->seed = (unsigned int)number;
+    } else {
+        return -1;
+    }
+    return *end == '\0' && number >= 0 ? 0 : -1;
+}
+
+// Function to create a simulated bus of parts with the given size, page
+// size and number of memory address bytes
+static inline int eepromSimOpen(I2cBus *bus, const char *path, unsigned int size, unsigned int pageSize,
+                                unsigned int addressBytes) {
+    char options[256];
+    const char *imagePath = NULL;
+    EepromSim *sim = calloc(1, sizeof(EepromSim));
+
+    memset(bus, 0, sizeof(*bus));
+    bus->fd = -1;
+    if (!sim) {
+        return -1;
+    }
+    sim->size = size;
+    sim->pageSize = pageSize;
+    sim->addressBytes = addressBytes;
+    while ((1u << (8 * addressBytes + sim->blockBits)) < size) {
+        sim->blockBits++;
+    }
+    sim->clockHz = 400e3;
+    sim->writeCycle = 0.005;
+    sim->deviceCount = 1;
+    sim->seed = 1;
+
+    const char *list = strchr(path, ':');
+    snprintf(options, sizeof(options), "%s", list ? list + 1 : "");
+    char *save;
+    for (char *option = strtok_r(options, ",", &save); option; option = strtok_r(NULL, ",", &save)) {
+        if (eepromSimOption(sim, option, &imagePath) != 0) {
+            fprintf(stderr, "Invalid simulator option %s\n", option);
+            free(sim);
+            return -1;
+        }
+    }
+    if (sim->clockHz < 1000 || sim->deviceCount < 1 || sim->deviceCount > EEPROM_SIM_MAX_DEVICES >> sim->blockBits ||
+        sim->errorRate > 1) {
+        fprintf(stderr, "Invalid simulator configuration %s\n", path);
+        free(sim);
+        return -1;
+    }
+
+    for (int i = 0; i < sim->deviceCount; i++) {
+        if (i == 0 && imagePath) {
+            if (eepromStoreOpen(&sim->image, imagePath, size, 0) != 0) {
+                eepromSimClose(&(I2cBus){&eepromSimBackend, -1, sim, NULL});
+                return -1;
+            }
+            sim->imageOpen = 1;
+            sim->devices[0].data = sim->image.data;
+            continue;
+        }
+        // A blank part reads back as all 0xFF
+        sim->devices[i].data = malloc(size);
+        if (!sim->devices[i].data) {
+            sim->deviceCount = i;
+            eepromSimClose(&(I2cBus){&eepromSimBackend, -1, sim, NULL});
+            return -1;
+        }
+        memset(sim->devices[i].data, 0xFF, size);
+    }
+
+    bus->backend = &eepromSimBackend;
+    bus->device = sim;
+    return 0;
+}
+
+#endif // EEPROM_SIM_H
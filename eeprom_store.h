@@ -0,0 +1,305 @@
+#ifndef EEPROM_STORE_H
+#define EEPROM_STORE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <libgen.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Backing store for the simulated EEPROM image.
+//
+// The default mode maps the image file with MAP_SHARED, so updates land
+// directly in the file and only the touched pages are flushed with msync.
+// The atomic mode works on a private copy and commits it by writing a
+// temporary file, fsyncing it and renaming it over the original, so a
+// crash never leaves a truncated image behind.
+
+// Maximum number of separate dirty ranges tracked before merging
+#define MAX_DIRTY_RANGES 16
+
+// Byte ranges of the image changed by the current run
+typedef struct {
+    size_t offset;
+    size_t length;
+} DirtyRange;
+
+typedef struct {
+    DirtyRange ranges[MAX_DIRTY_RANGES];
+    int count;
+} DirtyList;
+
+typedef struct {
+    const char *path;
+    int fd;
+    char *data;
+    size_t size;
+    int atomic;
+    DirtyList dirty;
+    size_t bytesChanged; // Bytes that differed and were written
+    size_t bytesSkipped; // Bytes that already held the requested value
+} EepromStore;
+
+// Function to record a changed byte range, merging overlapping or adjacent ranges
+static inline void markDirty(DirtyList *dirty, size_t offset, size_t length) {
+    size_t end = offset + length;
+
+    for (int i = 0; i < dirty->count; i++) {
+        DirtyRange *range = &dirty->ranges[i];
+        if (offset <= range->offset + range->length && end >= range->offset) {
+            size_t rangeEnd = range->offset + range->length;
+            range->offset = offset < range->offset ? offset : range->offset;
+            range->length = (end > rangeEnd ? end : rangeEnd) - range->offset;
+            return;
+        }
+    }
+
+    if (dirty->count == MAX_DIRTY_RANGES) {
+        // Out of slots, widen the last range to cover the new one
+        DirtyRange *range = &dirty->ranges[MAX_DIRTY_RANGES - 1];
+        size_t rangeEnd = range->offset + range->length;
+        range->offset = offset < range->offset ? offset : range->offset;
+        range->length = (end > rangeEnd ? end : rangeEnd) - range->offset;
+        return;
+    }
+
+    dirty->ranges[dirty->count].offset = offset;
+    dirty->ranges[dirty->count].length = length;
+    dirty->count++;
+}
+
+// Function to read the whole file into the private copy used by atomic mode
+static inline int eepromStoreLoadCopy(EepromStore *store) {
+    size_t loaded = 0;
+
+    // No file yet, the image starts out zero
+    while (store->fd >= 0 && loaded < store->size) {
+        ssize_t got = pread(store->fd, store->data + loaded, store->size - loaded, loaded);
+        if (got < 0) {
+            perror("Failed to load EEPROM data");
+            return -1;
+        }
+        if (got == 0) {
+            // Short file, the rest of the image stays zero
+            break;
+        }
+        loaded += got;
+    }
+    return 0;
+}
+
+// Function to open (creating if needed) an image of the given size
+static inline int eepromStoreOpen(EepromStore *store, const char *path, size_t size, int atomic) {
+    memset(store, 0, sizeof(*store));
+    store->path = path;
+    store->size = size;
+    store->atomic = atomic;
+
+    // Atomic mode creates the file only at commit, so a failed run leaves nothing behind
+    store->fd = open(path, atomic ? O_RDONLY : O_RDWR | O_CREAT, 0644);
+    if (store->fd < 0 && !(atomic && errno == ENOENT)) {
+        perror("Failed to open EEPROM data");
+        return -1;
+    }
+
+    if (atomic) {
+        store->data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    } else {
+        struct stat st;
+        if (fstat(store->fd, &st) != 0) {
+            perror("Failed to stat EEPROM data");
+            close(store->fd);
+            return -1;
+        }
+        // Grow a missing or short image with zeros so the whole mapping is backed
+        if ((size_t)st.st_size < size && ftruncate(store->fd, size) != 0) {
+            perror("Failed to size EEPROM data");
+            close(store->fd);
+            return -1;
+        }
+        store->data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, store->fd, 0);
+    }
+
+    if (store->data == MAP_FAILED) {
+        perror("Failed to map EEPROM data");
+        store->data = NULL;
+        close(store->fd);
+        return -1;
+    }
+
+    if (atomic && eepromStoreLoadCopy(store) != 0) {
+        munmap(store->data, size);
+        store->data = NULL;
+        close(store->fd);
+        return -1;
+    }
+    return 0;
+}
+
+// Function to record that a byte range of the image was modified
+static inline void eepromStoreTouch(EepromStore *store, size_t offset, size_t length) {
+    markDirty(&store->dirty, offset, length);
+}
+
+// Function to apply new contents (or a fill value when data is NULL) to a range.
+// Only the span between the first and last differing byte is written and
+// touched, so unchanged fields never dirty a page. Returns the bytes changed.
+static inline size_t eepromStoreApply(EepromStore *store, size_t offset, const void *data, int fill, size_t length) {
+    const unsigned char *src = data;
+    unsigned char *dst = (unsigned char *)store->data + offset;
+    size_t first = length, last = 0, changed = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        unsigned char value = src ? src[i] : (unsigned char)fill;
+        if (dst[i] != value) {
+            if (first == length) {
+                first = i;
+            }
+            last = i;
+            changed++;
+        }
+    }
+
+    store->bytesChanged += changed;
+    store->bytesSkipped += length - changed;
+    if (changed == 0) {
+        return 0;
+    }
+
+    if (src) {
+        memcpy(dst + first, src + first, last - first + 1);
+    } else {
+        memset(dst + first, fill, last - first + 1);
+    }
+    eepromStoreTouch(store, offset + first, last - first + 1);
+    return changed;
+}
+
+// Function to copy data into the image, writing only the bytes that differ
+static inline size_t eepromStoreUpdate(EepromStore *store, size_t offset, const void *data, size_t length) {
+    return eepromStoreApply(store, offset, data, 0, length);
+}
+
+// Function to fill a range of the image, writing only the bytes that differ
+static inline size_t eepromStoreFill(EepromStore *store, size_t offset, int value, size_t length) {
+    return eepromStoreApply(store, offset, NULL, value, length);
+}
+
+// Function to copy the bytes of the original file beyond the image into
+// the temporary file, so a file larger than --size keeps its tail
+static inline int eepromStoreCopyTail(EepromStore *store, int fd) {
+    char buffer[8192];
+    off_t offset = store->size;
+
+    for (;;) {
+        ssize_t got = store->fd >= 0 ? pread(store->fd, buffer, sizeof(buffer), offset) : 0;
+        if (got <= 0) {
+            return got < 0 ? -1 : 0;
+        }
+        for (ssize_t put = 0; put < got;) {
+            ssize_t done = write(fd, buffer + put, got - put);
+            if (done < 0) {
+                return -1;
+            }
+            put += done;
+        }
+        offset += got;
+    }
+}
+
+// Function to replace the image file with the private copy via a temporary
+// file. Each run gets its own temporary name, so concurrent commits to the
+// same image never write into each other's copy.
+static inline int eepromStoreCommitAtomic(EepromStore *store) {
+    char tempPath[PATH_MAX];
+    char dirPath[PATH_MAX];
+    struct stat info;
+
+    snprintf(tempPath, sizeof(tempPath), "%s.XXXXXX", store->path);
+    int fd = mkstemp(tempPath);
+    if (fd < 0) {
+        perror("Failed to create temporary EEPROM data");
+        return -1;
+    }
+    // mkstemp creates the file private; keep the image's permissions
+    fchmod(fd, store->fd >= 0 && fstat(store->fd, &info) == 0 ? info.st_mode & 07777 : 0644);
+
+    size_t written = 0;
+    while (written < store->size) {
+        ssize_t put = write(fd, store->data + written, store->size - written);
+        if (put < 0) {
+            perror("Failed to write temporary EEPROM data");
+            close(fd);
+            unlink(tempPath);
+            return -1;
+        }
+        written += put;
+    }
+    if (eepromStoreCopyTail(store, fd) != 0) {
+        perror("Failed to copy EEPROM data");
+        close(fd);
+        unlink(tempPath);
+        return -1;
+    }
+
+    if (fsync(fd) != 0 || close(fd) != 0) {
+        perror("Failed to flush temporary EEPROM data");
+        unlink(tempPath);
+        return -1;
+    }
+    if (rename(tempPath, store->path) != 0) {
+        perror("Failed to replace EEPROM data");
+        unlink(tempPath);
+        return -1;
+    }
+
+    // Make the rename itself durable
+    snprintf(dirPath, sizeof(dirPath), "%s", store->path);
+    int dirFd = open(dirname(dirPath), O_RDONLY | O_DIRECTORY);
+    if (dirFd >= 0) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+    return 0;
+}
+
+// Function to make all touched ranges durable
+static inline int eepromStoreCommit(EepromStore *store) {
+    if (store->dirty.count == 0) {
+        return 0;
+    }
+    if (store->atomic) {
+        return eepromStoreCommitAtomic(store);
+    }
+
+    // Flush only the pages covering the dirty ranges
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    for (int i = 0; i < store->dirty.count; i++) {
+        size_t start = store->dirty.ranges[i].offset & ~(pageSize - 1);
+        size_t end = store->dirty.ranges[i].offset + store->dirty.ranges[i].length;
+        if (msync(store->data + start, end - start, MS_SYNC) != 0) {
+            perror("Failed to save EEPROM data");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Function to release the mapping and the file
+static inline void eepromStoreClose(EepromStore *store) {
+    if (store->data) {
+        munmap(store->data, store->size);
+        store->data = NULL;
+    }
+    if (store->fd >= 0) {
+        close(store->fd);
+        store->fd = -1;
+    }
+}
+
+#endif // EEPROM_STORE_H